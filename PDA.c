@@ -15,9 +15,53 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <time.h>
 
-/* We have 26 possible nonterminal symbols */
-#define NUM_NONTERMS ('Z' - 'A' + 1)
+#include "pda.h"
+
+/* Tracing can be compiled out completely by building with -DPDA_TRACE=0.
+ * Otherwise, it can still be switched off at runtime.
+ */
+#ifndef PDA_TRACE
+#define PDA_TRACE 1
+#endif
+
+/* The same holds for the statistics of the backtracker, -DPDA_STATS=0 */
+#ifndef PDA_STATS
+#define PDA_STATS 1
+#endif
+
+/* Symbols are small integers.  Terminals are the chars of the input, 0 to
+ * 255, and nonterminals follow right after them.  So telling them apart is a
+ * single comparison, and a grammar can have up to MAX_NONTERMS nonterminals.
+ */
+typedef unsigned short symbol_t;
+
+#define NUM_TERMINALS 256
+#define MAX_NONTERMS (USHRT_MAX + 1 - NUM_TERMINALS)
+#define NONTERMINAL(INDEX) ((symbol_t)(NUM_TERMINALS + (INDEX)))
+#define NONTERM_INDEX(SYMBOL) ((SYMBOL) - NUM_TERMINALS)
+
+static inline bool is_nonterminal(symbol_t symbol)
+{
+	return symbol >= NUM_TERMINALS;
+}
+
+/* The built-in grammars name their nonterminals by capital letters */
+#define NUM_LETTERS ('Z' - 'A' + 1)
 
 /* We substitute char*** as grammar.  This is easier to understand (and to use)
  * as pointer to a pointer to a pointer of chars.
@@ -26,7 +70,7 @@ typedef const char ** rule;
 typedef const rule * grammar;
 
 #define DEFINE_GRAMMAR(name) \
-	rule name[NUM_NONTERMS]
+	rule name[NUM_LETTERS]
 
 /* This definition avoids redundant copy-pasting. A NULL marks the end of the
  * rule array
@@ -42,173 +86,7308 @@ typedef const rule * grammar;
 #define for_each_production(GRAMMAR, NTERM, RULE) \
 	for (RULE = GRAMMAR[NTERM - 'A']; RULE && *RULE; RULE++)
 
-/* struct stack can currently hold up to 1024 elements.
- * Should be enough for a simple grammar.  Note that we currenty do _not_ have
- * boundary checks.
+/* A symbol that can't derive any terminal word has an infinite yield */
+#define YIELD_INFINITE UINT_MAX
+
+/* A set of characters, one bit per char.  We use the NUL char, which never
+ * occurs in a word, as marker for the end of the input.
+ */
+#define END_OF_INPUT '\0'
+#define CHARSET_WORD_BITS (CHAR_BIT * sizeof(unsigned long))
+
+struct charset {
+	unsigned long bits[NUM_TERMINALS / CHARSET_WORD_BITS];
+};
+
+/* The compiled form of a grammar.  All productions live in one contiguous
+ * array, the productions of a nonterminal are adjacent: nonterminal i owns the
+ * productions nonterm[i].first to nonterm[i].first + nonterm[i].count - 1.
+ * The right sides of all productions are packed into symbols.  We store them
+ * in reverse order, so the right side can be pushed onto the stack with a
+ * single memcpy().
+ *
+ * yield is the minimal number of terminals that a production derives, and
+ * min_yield the minimal yield of each nonterminal.  A nonterminal with a
+ * minimal yield of zero is nullable, i.e., it derives the empty word.
+ * first_set holds the terminals that words derived from a nonterminal, or
+ * from the right side of a production, can start with.  cyclic marks the
+ * nonterminals that may lead the backtracker in circles, see calc_cycles().
+ * The names of the nonterminals, which we only need for printing, are stored
+ * back to back in names.
+ *
+ * Many productions start with a run of terminals, like B -> bBc.  The
+ * backtracker matches such a run against the input in one go.  prefix is
+ * the length of the run, and the run itself is stored as plain chars at
+ * prefix_offset in prefix_chars, so it can be compared with memcmp().
+ *
+ * Compiled grammars are built by add_nonterminal(), add_production() and
+ * finish_grammar().
+ */
+struct production {
+	unsigned int offset;
+	unsigned int len;
+	unsigned int yield;
+	unsigned int prefix;
+	unsigned int prefix_offset;
+	symbol_t lhs;
+	struct charset first_set;
+};
+
+struct nonterminal {
+	unsigned int first;
+	unsigned int count;
+	unsigned int min_yield;
+	unsigned int name;
+	struct charset first_set;
+	bool cyclic;
+};
+
+struct compiled_grammar {
+	struct production *productions;
+	unsigned int num_productions;
+	unsigned int productions_size;
+
+	symbol_t *symbols;
+	unsigned int num_symbols;
+	unsigned int symbols_size;
+
+	struct nonterminal *nonterm;
+	unsigned int num_nonterms;
+	unsigned int nonterms_size;
+
+	char *names;
+	unsigned int names_used;
+	unsigned int names_size;
+
+	char *prefix_chars;
+	unsigned int num_prefix_chars;
+};
+
+/* An LL(1) parse table: table[i][c] is the production to apply if nonterminal
+ * i is on top of the stack and c is the next char of the input, or -1 if
+ * there is none.  The table belongs to a left-factored copy of the original
+ * grammar.
+ */
+struct ll1 {
+	struct compiled_grammar g;
+	int (*table)[NUM_TERMINALS];
+};
+
+/* The tables of the CYK recognizer, see build_cyk().  They belong to a copy
+ * of the grammar in Chomsky normal form, which can't derive the empty word,
+ * so empty tells whether the original one did.  Sets of nonterminals are
+ * bitsets of set_words words.
  */
+#define CYK_MAX_TABLE (1UL << 30)
+
+struct cyk {
+	struct compiled_grammar g;
+	symbol_t start;
+	bool empty;
+	unsigned int set_words;
+
+	/* The nonterminals A with A -> c, for every char c */
+	unsigned long *terminal;
+
+	/* The binary productions A -> BC */
+	unsigned long *rights;
+	unsigned int *first_pair;
+	unsigned int *pair_right;
+	unsigned long *pair_heads;
+};
+
+/* The tables of the deterministic PDA that the SLR(1) construction yields,
+ * see build_lr().  Its states are the sets of LR(0) items of the grammar.
+ * action[s][c] tells what to do in state s if c is the next char of the
+ * input: shift c and go to another state, reduce by a production, accept the
+ * word, or reject it.  After reducing to nonterminal i, the PDA goes to state
+ * goto_state[s * num_nonterms + i], where s is the state that is uncovered by
+ * popping the right side.  For the tight loop of run_lr(), reduction tells
+ * the length and the left side of every production.
+ */
+#define LR_ERROR 0
+#define LR_ACCEPT -1
+#define LR_SHIFT(STATE) ((int)(STATE) + 1)
+#define LR_REDUCE(PRODUCTION) (-(int)(PRODUCTION) - 2)
+
+struct lr_reduction {
+	unsigned int len;
+	unsigned int nonterm;
+};
+
+struct lr {
+	unsigned int num_states;
+	unsigned int num_nonterms;
+	int (*action)[NUM_TERMINALS];
+	int *goto_state;
+	struct lr_reduction *reduction;
+};
+
+/* The verdict of an engine.  If the engine ran out of a resource, e.g., the
+ * stack hit its maximal depth, it can't tell whether the word is element of
+ * the language or not.  The same goes for a word that used up its budget of
+ * steps or time before the engine came to a decision.
+ */
+enum verdict {
+	VERDICT_NAY,
+	VERDICT_YEP,
+	VERDICT_LIMIT,
+	VERDICT_UNDECIDED,
+};
+
+/* By default, the stack may grow up to 16M symbols */
+#define STACK_DEFAULT_MAX_DEPTH (1U << 24)
+
+/* Reading the clock on every step would cost more than the step itself, so
+ * the backtracker only checks its deadline every so many steps.  Earley and
+ * CYK check it after every set and every span length, respectively.
+ */
+#define BUDGET_CLOCK_STEPS 1024
+
+/* Small stacks live in a buffer inside struct stack.  If a stack needs more
+ * space, it moves to the heap and doubles its size whenever it runs full, up
+ * to the configured maximal depth.  A production that would exceed the
+ * maximal depth is not applied, and the engine that wanted to apply it
+ * returns VERDICT_LIMIT instead of rejecting the word.
+ *
+ * yield is the minimal number of terminals that the current content of the
+ * stack will produce, i.e., the sum of all symbols' minimal yields.  peak is
+ * the highest top that the stack ever reached.
+ */
+#define STACK_INLINE_SIZE 1024
+
 struct stack {
-	char content[1024];
+	symbol_t *content;
+	unsigned int top;
+	unsigned int size;
+	unsigned int yield;
+	unsigned int peak;
+	symbol_t inline_content[STACK_INLINE_SIZE];
+};
+
+/* The memo remembers configurations of the PDA that are known to fail.  A
+ * configuration is the remaining word together with the full content of the
+ * stack.  As the remaining word is always a suffix of the initial word, the
+ * pointer to it uniquely identifies the read head's position.
+ *
+ * Stacks aren't copied into the memo, they're interned instead: every stack
+ * is a node of a trie, which holds its uppermost symbol and the node of the
+ * stack below.  Stacks that share their lower part share their nodes, and two
+ * stacks are the same iff they are the same node.  So an entry of the memo is
+ * just a position and a node, and we never reject a word because of a hash
+ * collision.  Both the nodes and the entries are found through open
+ * addressing hash tables, a free slot of node_table is 0, as node 0 is the
+ * empty stack, and a free entry has no word.
+ *
+ * ids caches the nodes of the current stack of the backtracker: ids[i] is
+ * the node of the lowest i + 1 symbols, for all i below known.  Whenever the
+ * backtracker rewrites the stack from some height on, known drops to that
+ * height, see memo_forget(), so the nodes are only looked up again for the
+ * symbols that changed.
+ *
+ * All of that takes at most MEMO_MAX_MEMORY bytes.  If the memo needs more,
+ * the backtracker gives up on the word with a limit.
+ */
+#define MEMO_MAX_MEMORY (256UL << 20)
+#define MEMO_EMPTY_STACK 0
+
+struct memo_node {
+	unsigned int below;
+	symbol_t symbol;
+};
+
+struct memo_entry {
+	const char *word;
+	unsigned int stack;
+};
+
+struct memo {
+	struct memo_entry *entries;
+	unsigned int size;
+	unsigned int used;
+
+	struct memo_node *nodes;
+	unsigned int num_nodes;
+	unsigned int nodes_size;
+
+	unsigned int *node_table;
+	unsigned int node_table_size;
+
+	unsigned int *ids;
+	unsigned int ids_size;
+	unsigned int known;
+
+	size_t memory;
+};
+
+/* A frame records one step of the PDA that popped symbol from a stack of
+ * height top.  pos is the position of the read head, and yield the minimal
+ * yield of the stack before the step.  For nonterminals, production is the
+ * index of the production that is currently applied, and below the index of
+ * the latest frame before, at the same position, whose top was not above
+ * ours, or FRAME_NONE.  A terminal frame popped a run of len terminals, which
+ * matched the input at pos.
+ */
+#define FRAME_TERMINAL -2
+#define FRAME_NONE UINT_MAX
+
+struct frame {
+	size_t pos;
+	unsigned int top;
+	unsigned int yield;
+	int production;
+	unsigned int len;
+	unsigned int below;
+	symbol_t symbol;
+};
+
+struct frames {
+	struct frame *frame;
+	unsigned int count;
+	unsigned int size;
+};
+
+/* The topmost item of a deterministic reduction path, for nonterminal symbol
+ * that completes at set.  If there's no such path, production is -1.
+ */
+struct leo_entry {
+	unsigned int set;
+	int production;
+	unsigned int origin;
+	symbol_t symbol;
+};
+
+/* An Earley item: production with a dot in front of the right side's symbol
+ * dot, that started matching at position origin of the word.  The chart
+ * stores the items of all Earley sets back to back, set i starts at item
+ * set[i].
+ */
+struct earley_item {
+	unsigned int production;
+	unsigned int dot;
+	unsigned int origin;
+};
+
+struct earley {
+	struct earley_item *items;
+	unsigned int count;
+	unsigned int size;
+
+	unsigned int *set;
+	unsigned int set_size;
+
+	/* Items that were scanned into the next set */
+	struct earley_item *next;
+	unsigned int next_count;
+	unsigned int next_size;
+
+	/* A hash table of item indices (+1, 0 marks a free slot) that lets us
+	 * quickly check whether the current set already contains an item.
+	 */
+	unsigned int *hash;
+	unsigned int hash_size;
+
+	/* The number of sets that were completed for the last word */
+	unsigned int complete;
+
+	/* Leo's optimization for right recursion, see earley_leo() */
+	struct leo_entry *leo;
+	unsigned int leo_size;
+	unsigned int leo_used;
+
+	struct leo_entry *path;
+	unsigned int path_size;
+};
+
+/* What the backtracker did.  expansions and failures count per production how
+ * often it was applied, and how often it was undone because the PDA didn't
+ * accept on that path.  A mismatch is a run of terminals, on the stack or
+ * at the beginning of a production, that didn't match the input, and pruned
+ * counts productions that were skipped without even trying them, as their
+ * yield or their FIRST set rules them out.  height is the maximal number of
+ * symbols on the stack, depth the maximal number of frames.
+ */
+struct stats {
+	unsigned long long *expansions;
+	unsigned long long *failures;
+	unsigned int num_productions;
+
+	unsigned long long matches;
+	unsigned long long mismatches;
+	unsigned long long pruned;
+	unsigned long long backtracks;
+	unsigned long long memo_hits;
+	unsigned int height;
+	unsigned int depth;
+};
+
+/* A binary trace, for -B, has one record per step of the engine, and takes a
+ * fraction of the time and the space of the text trace.  pos is the position
+ * of the read head and depth the number of symbols on the stack, or states
+ * for the SLR(1) engine, before the step.  event is the production that the
+ * step applied, or one of enum trace_event.  The first record of a word tells
+ * its length in pos, the last its verdict.  Steps are counted from the start
+ * of every word, and only the low 32 bits make it into the record.
+ *
+ * The records are collected in a buffer of TRACE_BUFFER_RECORDS, which is
+ * written out in one go whenever it's full, so tracing doesn't do any I/O in
+ * most steps.
+ */
+#define TRACE_MAGIC "PDA trace"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_RECORDS 65536
+
+enum trace_event {
+	/* Terminals on top of the stack matched the input, or the SLR(1)
+	 * engine shifted a char
+	 */
+	TRACE_MATCH = -1,
+	/* The backtracker hit a dead end */
+	TRACE_FAIL = -2,
+	TRACE_WORD = -3,
+	TRACE_VERDICT = -4,
+};
+
+struct trace_record {
+	unsigned int step;
+	unsigned int pos;
+	unsigned int depth;
+	int event;
+};
+
+/* The nodes of parse trees are allocated from an arena of blocks.  Allocating
+ * a node just bumps a pointer, and the whole tree is freed at once by resetting
+ * the arena.  The blocks are kept for the next tree.
+ */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	void *data[];
+};
+
+struct arena {
+	struct arena_block *first;
+	struct arena_block *current;
+};
+
+/* A node of a parse tree.  The children of a node are linked by sibling. */
+struct tree_node {
+	symbol_t symbol;
+	unsigned int depth;
+	struct tree_node *parent;
+	struct tree_node *child;
+	struct tree_node *sibling;
+};
+
+enum derivation_format {
+	DERIVATION_NONE,
+	DERIVATION_LIST,
+	DERIVATION_TREE,
+};
+
+enum stats_format {
+	STATS_NONE,
+	STATS_TEXT,
+	STATS_JSON,
+};
+
+enum engine {
+	ENGINE_BACKTRACK,
+	ENGINE_LL1,
+	ENGINE_EARLEY,
+	ENGINE_CYK,
+	ENGINE_SLR,
+	NUM_ENGINES
+};
+
+/* Everything the PDA needs to know while it runs.  This is never modified
+ * while words are recognized.
+ */
+struct pda {
+	const struct compiled_grammar *g;
+	symbol_t start;
+	enum engine engine;
+
+	/* Remember failed configurations */
+	bool memoize;
+
+	/* The backtracker has to look out for circles, see calc_cycles() */
+	bool cyclic;
+
+	/* The LL(1) parse table, if the grammar allows to build one */
+	const struct ll1 *ll1;
+
+	/* The tables of the CYK engine */
+	const struct cyk *cyk;
+
+	/* The tables of the SLR(1) engine, if the grammar allows to build them */
+	const struct lr *lr;
+
+	/* Print every configuration that the PDA runs through */
+	bool trace;
+
+	/* If not NULL, record a binary trace of every step to this file */
+	FILE *trace_file;
+
+	/* Collect statistics of the backtracker */
+	enum stats_format stats;
+
+	/* Print how accepted words are derived */
+	enum derivation_format derivation;
+
+	/* The maximal number of symbols on the stack */
+	unsigned int max_depth;
+
+	/* The budget of the backtracker per word: the maximal number of steps,
+	 * and the time in nanoseconds.  0 means no limit.
+	 */
+	unsigned long long max_steps;
+	unsigned long long timeout;
+
+	/* If not 0, deepen iteratively: search with a stack of at most deepen
+	 * symbols first, and double the depth while that's too shallow.
+	 */
+	unsigned int deepen;
+
+	/* Every line of a batch is an edit of the line before */
+	bool incremental;
+
+	/* The number of threads that search for a derivation of one word */
+	unsigned int parallel;
+};
+
+/* Only the top levels of the search are split into tasks, deeper ones run
+ * sequentially, unless a searcher hands its configuration over, see
+ * search_donate().
+ */
+#define SEARCH_SPLIT_LEVELS 64
+
+/* The parallel search of the backtracker for a single word.  A task is a
+ * configuration of the PDA that's left to explore: the position of the read
+ * head, and a snapshot of the stack.  level tells how often the tasks that
+ * led to it were split.
+ */
+struct task {
+	size_t pos;
+	symbol_t *content;
 	unsigned int top;
+	unsigned int yield;
+	unsigned int level;
+};
+
+/* Every searcher runs in its own thread, with its own scratch memory, and owns
+ * a deque of tasks.  It takes its own tasks from the tail, and when it runs
+ * dry, it steals from the heads of the others.  So thieves get the oldest
+ * tasks, which tend to be the largest.
+ */
+struct searcher {
+	pthread_t thread;
+	struct search *search;
+	struct scratch *scratch;
+
+	pthread_mutex_t lock;
+	struct task *task;
+	unsigned int head;
+	unsigned int count;
+	unsigned int size;
+
+	/* The tasks that splitting a task yields */
+	struct task *children;
+	unsigned int children_size;
+};
+
+struct search {
+	const struct pda *pda;
+	const char *word;
+	size_t len;
+
+	struct searcher *searcher;
+	unsigned int count;
+
+	/* The searchers run as long as the search exists, and wait for wake
+	 * between the words.  Every word has a generation of its own, and
+	 * running counts the searchers that are still working on it, the
+	 * last one signals finished.  quit tells them to end.  An idle
+	 * searcher waits for work, until there's a task to take or the search
+	 * of the word is over.
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t finished;
+	pthread_cond_t work;
+	unsigned long generation;
+	unsigned int running;
+	bool quit;
+
+	/* pending counts the tasks that are queued or being explored, the
+	 * search is over when they're all gone.  idle counts the searchers
+	 * that look for a task.
+	 */
+	atomic_uint pending;
+	atomic_uint queued;
+	atomic_uint idle;
+
+	/* Once a searcher accepts the word or runs out of budget, the verdict
+	 * is clear, and done cancels everybody else.
+	 */
+	atomic_bool done;
+	atomic_bool accepted;
+	atomic_bool limited;
+	atomic_bool undecided;
+
+	/* Some searcher gave up with a full memo, see struct scratch */
+	atomic_bool memo_full;
+};
+
+/* The memory that the engines work in.  It's kept from one word to the next,
+ * so once the buffers have grown large enough, recognizing a word doesn't
+ * allocate any memory.
+ */
+struct scratch {
+	struct stack stack;
+	struct frames frames;
+	struct memo memo;
+	struct earley earley;
+
+	/* The CYK table, cyk_size words */
+	unsigned long *cyk_table;
+	size_t cyk_size;
+
+	/* The stack of states of the SLR(1) engine */
+	unsigned int *lr_states;
+	unsigned int lr_size;
+
+	/* The maximal depth of the stack for the current round of the
+	 * backtracker, and how far it got with its budget.  When steps reaches
+	 * next_check, the budget is checked again.
+	 */
+	unsigned int depth;
+	unsigned long long steps;
+	unsigned long long next_check;
+	unsigned long long deadline;
+
+	/* The last run of the backtracker gave up with Limit because the memo
+	 * was full, not because it hit the depth.  Deepening wouldn't help.
+	 */
+	bool memo_full;
+
+	/* The threads of the parallel search, started on first use */
+	struct search *search;
+
+	/* If not NULL, this is the scratch of a searcher */
+	struct searcher *searcher;
+
+	/* The records of the binary trace that weren't written yet */
+	struct trace_record *trace_records;
+	unsigned int trace_count;
+
+	/* How many words and chars were recognized, for -b */
+	unsigned long words;
+	unsigned long long chars;
+
+	struct stats stats;
+
+	/* The parse tree of the last word */
+	struct arena arena;
 };
 
+/* Count n events of the backtracker, unless statistics are off */
+#define count_stat(PDA, SCRATCH, FIELD, N) \
+	do { \
+		if (PDA_STATS && (PDA)->stats) \
+			(SCRATCH)->stats.FIELD += (N); \
+	} while (0)
+
 const static DEFINE_GRAMMAR(wtf) = {
 	RULE('S', "AB"),
 	RULE('A', "aA", "a"),
 	RULE('B', "bBc", "bc"),
 };
 
-static void dump_grammar(grammar g)
+static unsigned int add_yield(unsigned int a, unsigned int b)
 {
-	unsigned int i;
-	rule right;
+	if (a == YIELD_INFINITE || b == YIELD_INFINITE ||
+	    a + b < a || a + b == YIELD_INFINITE)
+		return YIELD_INFINITE;
+	return a + b;
+}
 
-	/* We iterate over every possible nonterminal symol */
-	for (i = 0; i < NUM_NONTERMS; i++) {
-		/* We assigning the array of rules for the non-terminal i to
-		 * the rule "right". The if-condition then checks wether this
-		 * rule is actually present. If we didn't define any rule, g[i]
-		 * would be NULL, and we simply skip it. */
-		if ((right = g[i])) {
-			/* right points to an array holding all rules of the
-			 * nonterminal symbol.  If this *right is NULL, we have
-			 * reached the end of the list of rules.
-			 * (cf. #define RULE(...) { __VA_ARGS__, NULL })
-			 *					 ^^^^
-			 */
-			while (*right) {
-				/* Print the content of the current rule.
-				 * We're interested in the destination of the
-				 * production, so dereference. After printing,
-				 * we increment our pointer to the next
-				 * possible element and we check again.
-				 */
-				printf("%c -> %s\n", 'A' + i, *right++);
-			}
-		}
-	}
+static struct nonterminal *nonterminal(const struct compiled_grammar *cg,
+				       symbol_t symbol)
+{
+	return &cg->nonterm[NONTERM_INDEX(symbol)];
 }
 
-static bool run_pda(grammar g, const char *word, struct stack stack)
+static unsigned int symbol_yield(const struct compiled_grammar *cg,
+				 symbol_t symbol)
 {
-	char top_stack, top_input;
-	int i;
-	rule rule_pointer;
+	/* A terminal symbol always yields itself */
+	if (!is_nonterminal(symbol))
+		return 1;
+	return nonterminal(cg, symbol)->min_yield;
+}
 
-	/* Show the grammar that we use */
-	printf("Word: %s\t\t Stack: ", word);
-	/* The uppermost (last element in the array) must come first.  So read
-	 * the array in reverse order.
-	 */
-	for (i = stack.top - 1; i >= 0; i--)
-		printf("%c", stack.content[i]);
-	printf("\n");
+static unsigned int production_yield(const struct compiled_grammar *cg,
+				     const struct production *p)
+{
+	const symbol_t *symbol = cg->symbols + p->offset;
+	unsigned int i, yield = 0;
 
-	/* If our stack is empty, we still might have characters left in our
-	 * word. If so, the run of our PDA was not successful. Otherwise, it
-	 * was successful.
-	 */
-	if (stack.top == 0)
-		return strlen(word) == 0;
+	for (i = 0; i < p->len; i++)
+		yield = add_yield(yield, symbol_yield(cg, symbol[i]));
 
-	/* Pop the uppermost element from our stack.
-	 * First we decrease stack.top to point to the current uppermost
-	 * element, because stack.top points to the next free slot.  Thus we
-	 * can get the uppermost element while maintaining the stack's
-	 * position.
-	 */
-	top_stack = stack.content[--stack.top]; // POP
+	return yield;
+}
 
-	/* Check if we have a nonterminal character on our stack */
-	if (isupper(top_stack)) {
-		/* Iterate over each available production rule for the
-		 * non-terminal 'top_stack'
-		 */
-		for_each_production(g, top_stack, rule_pointer) {
-			/* Make a copy of our stack so it doesn't get modified
-			 * when we recursively call ourself.
-			 */
-			struct stack tmp = stack;
-			const char *rule = *rule_pointer;
-			const int rule_len = strlen(rule);
-
-			/* back points to the highest element in our stack
-			 * after we push the rule contents on it. */
-			char *back = tmp.content + tmp.top + rule_len - 1;
-
-			/* Iterate over every character of the current rule */
-			while (*rule) {
-				/* And copy it over to our stack. We do start
-				 * from the end, thus making the first element
-				 * of our rule the uppermost.
-				 */
-				*back-- = *rule++;
-			}
+/* Calculate the minimal yield for each nonterminal.  We start by assuming
+ * that every nonterminal's yield is infinite, and iteratively lower the
+ * yield as long as we find a production that yields less.  As yields only
+ * decrease, this terminates.  Nonterminals that still have an infinite yield
+ * in the end can't derive any terminal word at all.
+ */
+static void calc_min_yield(struct compiled_grammar *cg)
+{
+	struct nonterminal *nterm;
+	struct production *p;
+	unsigned int i, yield;
+	bool changed;
 
-			/* Our stack just grew by rule_len elements. Maintain
-			 * its size.
-			 */
-			tmp.top += rule_len;
+	for (i = 0; i < cg->num_nonterms; i++)
+		cg->nonterm[i].min_yield = YIELD_INFINITE;
 
-			/* Recursively run the PDA with the new stack. Return
-			 * if it was successful.
-			 */
-			if (run_pda(g, word, tmp))
-				return true;
+	do {
+		changed = false;
+		for (i = 0; i < cg->num_productions; i++) {
+			p = &cg->productions[i];
+			nterm = nonterminal(cg, p->lhs);
+			yield = production_yield(cg, p);
+			if (yield < nterm->min_yield) {
+				nterm->min_yield = yield;
+				changed = true;
+			}
 		}
-		/* If no production led to a positive result, the overall
-		 * result is false.
-		 */
-		return false;
+	} while (changed);
+
+	for (i = 0; i < cg->num_productions; i++)
+		cg->productions[i].yield =
+			production_yield(cg, &cg->productions[i]);
+}
+
+static void charset_add(struct charset *set, unsigned char c)
+{
+	set->bits[c / CHARSET_WORD_BITS] |= 1UL << (c % CHARSET_WORD_BITS);
+}
+
+static bool charset_has(const struct charset *set, unsigned char c)
+{
+	return set->bits[c / CHARSET_WORD_BITS] & (1UL << (c % CHARSET_WORD_BITS));
+}
+
+/* Add all chars of src to dst.  Returns true if dst changed. */
+static bool charset_union(struct charset *dst, const struct charset *src)
+{
+	unsigned long old;
+	bool changed = false;
+	unsigned int i;
+
+	for (i = 0; i < NUM_TERMINALS / CHARSET_WORD_BITS; i++) {
+		old = dst->bits[i];
+		dst->bits[i] |= src->bits[i];
+		changed |= dst->bits[i] != old;
 	}
 
-	/* Here we land if we have a terminal char on our stack. */
+	return changed;
+}
 
-	/* Check if we actually have any chars left in our word. If no, the
-	 * stack is not empty, and the PDA does not accept the word.
-	 */
-	if (strlen(word) == 0)
-		return false;
+/* Returns the i-th symbol of the right side of production p */
+static symbol_t production_symbol(const struct compiled_grammar *cg,
+				  const struct production *p, unsigned int i)
+{
+	return cg->symbols[p->offset + p->len - 1 - i];
+}
 
-	/* Get the next char from our word and move the read head one char to
-	 * the right.
-	 */
-	top_input = word[0];
-	word++;
+static bool nullable(const struct compiled_grammar *cg, symbol_t symbol)
+{
+	return is_nonterminal(symbol) &&
+	       nonterminal(cg, symbol)->min_yield == 0;
+}
 
-	/* If the current char on the stack is equal to the left-most char of
-	 * the word, run the PDA on the rest-word and the stack.
-	 */
-	if (top_input == top_stack)
-		return run_pda(g, word, stack);
+/* Add the chars that the symbols from+1 to len of production p can start
+ * with to set.  Returns true if all those symbols are nullable.
+ */
+static bool first_of_suffix(const struct compiled_grammar *cg,
+			    const struct production *p, unsigned int from,
+			    struct charset *set)
+{
+	unsigned int i;
+	symbol_t symbol;
 
-	/* Either the char on the stack and the next char are not equal or the
-	 * PDA didn't recognize the word in any path.
-	 */
-	return false;
+	for (i = from; i < p->len; i++) {
+		symbol = production_symbol(cg, p, i);
+		if (!is_nonterminal(symbol)) {
+			charset_add(set, symbol);
+			return false;
+		}
+		charset_union(set, &nonterminal(cg, symbol)->first_set);
+		if (!nullable(cg, symbol))
+			return false;
+	}
+
+	return true;
 }
 
-int main(int argc, char **argv)
+/* Calculate the FIRST sets of all nonterminals.  Just as for the yields, we
+ * iterate until nothing changes any longer.
+ */
+static void calc_first_sets(struct compiled_grammar *cg)
 {
-	bool ret;
+	struct production *p;
+	struct charset set;
+	unsigned int i;
+	bool changed;
 
-	/* Initially, our stack holds one element: the start symbol 'S' */
-	struct stack s = {
-		.top = 1,
-		.content = { 'S' },
-	};
+	for (i = 0; i < cg->num_nonterms; i++)
+		memset(&cg->nonterm[i].first_set, 0, sizeof(set));
+	do {
+		changed = false;
+		for (i = 0; i < cg->num_productions; i++) {
+			p = &cg->productions[i];
+			memset(&set, 0, sizeof(set));
+			first_of_suffix(cg, p, 0, &set);
+			changed |= charset_union(
+				&nonterminal(cg, p->lhs)->first_set, &set);
+		}
+	} while (changed);
 
-	/* Check if we do have a single command line argument (2 because argc
-	 * and argv are build like this: <program_name> <argument1> ...
-	 */
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s word\n", argv[0]);
-		return -1;
+	for (i = 0; i < cg->num_productions; i++) {
+		p = &cg->productions[i];
+		memset(&p->first_set, 0, sizeof(p->first_set));
+		first_of_suffix(cg, p, 0, &p->first_set);
 	}
+}
 
-	dump_grammar(wtf);
+/* Returns Y if p is a production X -> ... Y, and all symbols in front of Y
+ * are nullable, 0 otherwise
+ */
+static symbol_t cycle_successor(const struct compiled_grammar *cg,
+				const struct production *p)
+{
+	unsigned int i;
+	symbol_t last;
 
-	ret = run_pda(wtf, argv[1], s);
-	printf("%s\n", ret ? "Yep" : "Nay");
+	if (!p->len)
+		return 0;
+	last = production_symbol(cg, p, p->len - 1);
+	if (!is_nonterminal(last))
+		return 0;
+	for (i = 0; i + 1 < p->len; i++)
+		if (!nullable(cg, production_symbol(cg, p, i)))
+			return 0;
 
-	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+	return last;
 }
+
+/* If a nonterminal X derives X again, behind symbols that all derive the empty
+ * word, the backtracker can run into the very same configuration again: X on
+ * top of the same stack, at the same position of the input.  Neither the
+ * yields nor the depth of the stack put an end to that, so the backtracker has
+ * to look out for repetitions, see repeats().  That's only necessary for
+ * nonterminals that can be part of such a cycle, which is what cyclic tells.
+ *
+ * Say X leads to Y if cycle_successor() of a production of X is Y.  Every
+ * nonterminal starts out cyclic, and those that don't lead to any cyclic one
+ * are not, until nothing changes.  The nonterminals that are left are on a
+ * cycle, or lead to one, which is close enough.
+ */
+static void calc_cycles(struct compiled_grammar *cg)
+{
+	const unsigned int n = cg->num_nonterms;
+	unsigned int *out, *first, *cursor, *pred, *queue;
+	unsigned int i, from, to, head = 0, tail = 0;
+	symbol_t next;
+
+	/* The nonterminals that lead to every nonterminal, back to back */
+	out = calloc(n + 1, sizeof(*out));
+	first = calloc(n + 2, sizeof(*first));
+	cursor = malloc((n + 1) * sizeof(*cursor));
+	pred = malloc((cg->num_productions + 1) * sizeof(*pred));
+	queue = malloc((n + 1) * sizeof(*queue));
+	if (!out || !first || !cursor || !pred || !queue) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < cg->num_productions; i++) {
+		next = cycle_successor(cg, &cg->productions[i]);
+		if (next) {
+			out[NONTERM_INDEX(cg->productions[i].lhs)]++;
+			first[NONTERM_INDEX(next) + 1]++;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		first[i + 1] += first[i];
+		cursor[i] = first[i];
+	}
+	for (i = 0; i < cg->num_productions; i++) {
+		next = cycle_successor(cg, &cg->productions[i]);
+		if (next)
+			pred[cursor[NONTERM_INDEX(next)]++] =
+				NONTERM_INDEX(cg->productions[i].lhs);
+	}
+
+	for (i = 0; i < n; i++) {
+		cg->nonterm[i].cyclic = out[i];
+		if (!out[i])
+			queue[tail++] = i;
+	}
+	while (head < tail) {
+		to = queue[head++];
+		for (i = first[to]; i < first[to + 1]; i++) {
+			from = pred[i];
+			if (!--out[from]) {
+				cg->nonterm[from].cyclic = false;
+				queue[tail++] = from;
+			}
+		}
+	}
+
+	free(out);
+	free(first);
+	free(cursor);
+	free(pred);
+	free(queue);
+}
+
+static bool has_cycles(const struct compiled_grammar *cg)
+{
+	unsigned int i;
+
+	for (i = 0; i < cg->num_nonterms; i++)
+		if (cg->nonterm[i].cyclic)
+			return true;
+
+	return false;
+}
+
+static const char *nonterminal_name(const struct compiled_grammar *cg,
+				    symbol_t symbol)
+{
+	return cg->names + nonterminal(cg, symbol)->name;
+}
+
+/* Returns the nonterminal called name, where name has len chars, or 0, which
+ * is no nonterminal, if there's none.
+ */
+static symbol_t find_nonterminal(const struct compiled_grammar *cg,
+				 const char *name, unsigned int len)
+{
+	const struct nonterminal *nterm;
+	unsigned int i;
+
+	for (i = 0; i < cg->num_nonterms; i++) {
+		nterm = &cg->nonterm[i];
+		if (!strncmp(cg->names + nterm->name, name, len) &&
+		    !cg->names[nterm->name + len])
+			return NONTERMINAL(i);
+	}
+
+	return 0;
+}
+
+/* Just like find_nonterminal(), but if there's no such nonterminal yet, it's
+ * added to cg.  Returns 0 if cg already has MAX_NONTERMS nonterminals.
+ */
+static symbol_t add_nonterminal(struct compiled_grammar *cg, const char *name,
+				unsigned int len)
+{
+	struct nonterminal *nterm;
+	symbol_t symbol;
+
+	symbol = find_nonterminal(cg, name, len);
+	if (symbol)
+		return symbol;
+
+	if (cg->num_nonterms == MAX_NONTERMS)
+		return 0;
+
+	if (cg->num_nonterms == cg->nonterms_size) {
+		cg->nonterms_size = cg->nonterms_size ?
+				    cg->nonterms_size * 2 : 16;
+		cg->nonterm = realloc(cg->nonterm, cg->nonterms_size *
+				      sizeof(*cg->nonterm));
+	}
+	while (cg->names_used + len + 1 > cg->names_size) {
+		cg->names_size = cg->names_size ? cg->names_size * 2 : 64;
+		cg->names = realloc(cg->names, cg->names_size);
+	}
+	if (!cg->nonterm || !cg->names) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+
+	nterm = &cg->nonterm[cg->num_nonterms];
+	memset(nterm, 0, sizeof(*nterm));
+	nterm->name = cg->names_used;
+	memcpy(cg->names + cg->names_used, name, len);
+	cg->names[cg->names_used + len] = '\0';
+	cg->names_used += len + 1;
+
+	return NONTERMINAL(cg->num_nonterms++);
+}
+
+/* Append the production lhs -> right to cg, where right has len symbols.
+ * Once all productions are added, the grammar must be finished with
+ * finish_grammar().
+ */
+static void add_production(struct compiled_grammar *cg, symbol_t lhs,
+			   const symbol_t *right, unsigned int len)
+{
+	struct production *p;
+	unsigned int i;
+
+	if (cg->num_productions == cg->productions_size) {
+		cg->productions_size = cg->productions_size ?
+				       cg->productions_size * 2 : 16;
+		cg->productions = realloc(cg->productions,
+					  cg->productions_size *
+					  sizeof(*cg->productions));
+		if (!cg->productions) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	/* Note that an empty right side doesn't need any symbols */
+	while (cg->num_symbols + len > cg->symbols_size) {
+		cg->symbols_size = cg->symbols_size ?
+				   cg->symbols_size * 2 : 64;
+		cg->symbols = realloc(cg->symbols, cg->symbols_size *
+				      sizeof(*cg->symbols));
+		if (!cg->symbols) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	p = &cg->productions[cg->num_productions++];
+	p->lhs = lhs;
+	p->len = len;
+	p->offset = cg->num_symbols;
+
+	/* Reverse the right side, its first symbol must end up as the
+	 * uppermost element of the stack.
+	 */
+	for (i = 0; i < len; i++)
+		cg->symbols[cg->num_symbols++] = right[len - 1 - i];
+}
+
+/* Collect the leading run of terminals of every production */
+static void calc_prefixes(struct compiled_grammar *cg)
+{
+	struct production *p;
+	symbol_t symbol;
+	unsigned int i;
+
+	free(cg->prefix_chars);
+	cg->prefix_chars = malloc(cg->num_symbols + 1);
+	if (!cg->prefix_chars) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	cg->num_prefix_chars = 0;
+	for (i = 0; i < cg->num_productions; i++) {
+		p = &cg->productions[i];
+		p->prefix_offset = cg->num_prefix_chars;
+		for (p->prefix = 0; p->prefix < p->len; p->prefix++) {
+			symbol = production_symbol(cg, p, p->prefix);
+			if (is_nonterminal(symbol))
+				break;
+			cg->prefix_chars[cg->num_prefix_chars++] = symbol;
+		}
+	}
+}
+
+/* Group the productions by their nonterminal and precompute everything that
+ * the engines need to know about the grammar.  The order of the productions
+ * of each nonterminal is preserved, as this is the order in which the
+ * backtracker tries them.
+ */
+static void finish_grammar(struct compiled_grammar *cg)
+{
+	struct production *sorted;
+	struct nonterminal *nterm;
+	unsigned int i;
+
+	sorted = malloc(cg->num_productions * sizeof(*sorted) + 1);
+	if (!sorted) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* A counting sort keeps the order within each nonterminal */
+	for (i = 0; i < cg->num_nonterms; i++)
+		cg->nonterm[i].count = 0;
+	for (i = 0; i < cg->num_productions; i++)
+		nonterminal(cg, cg->productions[i].lhs)->count++;
+	for (i = 0; i < cg->num_nonterms; i++) {
+		cg->nonterm[i].first = i ? cg->nonterm[i - 1].first +
+					   cg->nonterm[i - 1].count : 0;
+	}
+	for (i = 0; i < cg->num_nonterms; i++)
+		cg->nonterm[i].count = 0;
+	for (i = 0; i < cg->num_productions; i++) {
+		nterm = nonterminal(cg, cg->productions[i].lhs);
+		sorted[nterm->first + nterm->count++] = cg->productions[i];
+	}
+
+	free(cg->productions);
+	cg->productions = sorted;
+	cg->productions_size = cg->num_productions;
+
+	calc_min_yield(cg);
+	calc_first_sets(cg);
+	calc_cycles(cg);
+	calc_prefixes(cg);
+}
+
+/* In the built-in grammars, capital letters are nonterminals */
+static symbol_t letter_symbol(struct compiled_grammar *cg, char c)
+{
+	if (isupper((unsigned char)c))
+		return add_nonterminal(cg, &c, 1);
+	return (unsigned char)c;
+}
+
+/* Compile grammar g to its flat representation.  This is done once, before
+ * the PDA runs.  The start symbol of the built-in grammars is S.
+ */
+static void compile_grammar(grammar g, struct compiled_grammar *cg,
+			    symbol_t *start)
+{
+	unsigned int i, len, size = 0;
+	symbol_t *right = NULL;
+	rule r;
+
+	memset(cg, 0, sizeof(*cg));
+
+	/* Number the nonterminals in alphabetical order */
+	for (i = 0; i < NUM_LETTERS; i++)
+		if (g[i] && *g[i])
+			letter_symbol(cg, 'A' + i);
+
+	for (i = 0; i < NUM_LETTERS; i++) {
+		for_each_production(g, 'A' + i, r) {
+			if (strlen(*r) > size) {
+				size = strlen(*r);
+				free(right);
+				right = malloc(size * sizeof(*right));
+				if (!right) {
+					perror("malloc");
+					exit(EXIT_FAILURE);
+				}
+			}
+			for (len = 0; (*r)[len]; len++)
+				right[len] = letter_symbol(cg, (*r)[len]);
+			add_production(cg, letter_symbol(cg, 'A' + i), right,
+				       len);
+		}
+	}
+	free(right);
+
+	*start = letter_symbol(cg, 'S');
+	finish_grammar(cg);
+}
+
+static void free_grammar(struct compiled_grammar *cg)
+{
+	free(cg->productions);
+	free(cg->symbols);
+	free(cg->nonterm);
+	free(cg->names);
+	free(cg->prefix_chars);
+}
+
+static void print_symbol(FILE *stream, const struct compiled_grammar *cg,
+			 symbol_t symbol)
+{
+	if (is_nonterminal(symbol))
+		fputs(nonterminal_name(cg, symbol), stream);
+	else
+		fputc(symbol, stream);
+}
+
+static void print_production(FILE *stream, const struct compiled_grammar *cg,
+			     const struct production *p)
+{
+	unsigned int i;
+
+	fprintf(stream, "%s -> ", nonterminal_name(cg, p->lhs));
+	for (i = 0; i < p->len; i++)
+		print_symbol(stream, cg, production_symbol(cg, p, i));
+}
+
+#ifndef PDA_LIBRARY
+static void dump_grammar(const struct compiled_grammar *cg)
+{
+	unsigned int i;
+
+	/* The productions are grouped by their nonterminal, which is exactly
+	 * the order in which we want to print them.
+	 */
+	for (i = 0; i < cg->num_productions; i++) {
+		print_production(stdout, cg, &cg->productions[i]);
+		printf("\n");
+	}
+}
+#endif
+
+/* Parse the symbol at *c and advance *c behind it.  A capital letter, or a
+ * name in angle brackets like <expr>, is a nonterminal.  Returns false if
+ * the grammar has too many nonterminals.
+ */
+static bool parse_symbol(struct compiled_grammar *cg, const char **c,
+			 symbol_t *symbol)
+{
+	const char *end;
+
+	if (isupper((unsigned char)**c)) {
+		*symbol = add_nonterminal(cg, *c, 1);
+		(*c)++;
+		return *symbol;
+	}
+
+	if (**c == '<') {
+		for (end = *c + 1; *end && *end != '>' && *end != '<' &&
+		     *end != '|' && !isspace((unsigned char)*end); end++)
+			;
+		if (*end == '>' && end > *c + 1) {
+			*symbol = add_nonterminal(cg, *c, end + 1 - *c);
+			*c = end + 1;
+			return *symbol;
+		}
+	}
+
+	*symbol = (unsigned char)**c;
+	(*c)++;
+	return true;
+}
+
+/* Grammars can be loaded at runtime from text files like this one:
+ *
+ *	# a^n b^m c^m
+ *	S -> AB
+ *	A -> aA | a
+ *	B -> bBc | bc
+ *
+ * Every line defines productions for the nonterminal on the left side of
+ * "->", alternatives are separated by '|'.  Capital letters and names in
+ * angle brackets, like <expr>, are nonterminal symbols, everything else is a
+ * terminal.  Whitespace is ignored, an empty alternative is the empty word.
+ * '#' starts a comment.  The nonterminal of the first line is the start
+ * symbol.
+ *
+ * The grammar is validated while it is loaded: errors are reported with their
+ * line, and every nonterminal that is used must have a production.
+ */
+static bool parse_grammar(FILE *stream, const char *name,
+			  struct compiled_grammar *cg, symbol_t *start)
+{
+	unsigned int line_no = 0, len, i;
+	symbol_t lhs, *right = NULL;
+	const char *c;
+	char *line = NULL, *comment;
+	bool *defined;
+	size_t size = 0;
+	bool ret = true;
+
+	memset(cg, 0, sizeof(*cg));
+	*start = 0;
+
+	while (getline(&line, &size, stream) != -1) {
+		line_no++;
+
+		/* Strip the comment, skip empty lines */
+		if ((comment = strchr(line, '#')))
+			*comment = '\0';
+		for (c = line; isspace((unsigned char)*c); c++)
+			;
+		if (!*c)
+			continue;
+
+		if (!parse_symbol(cg, &c, &lhs)) {
+			fprintf(stderr, "%s:%u: too many nonterminals\n", name,
+				line_no);
+			ret = false;
+			break;
+		}
+		while (isspace((unsigned char)*c))
+			c++;
+		if (!is_nonterminal(lhs) || strncmp(c, "->", 2)) {
+			fprintf(stderr, "%s:%u: expected 'X -> ...'\n", name,
+				line_no);
+			ret = false;
+			continue;
+		}
+		c += 2;
+
+		if (!*start)
+			*start = lhs;
+
+		/* right collects the alternative without any whitespace.  It
+		 * can't get longer than the line.
+		 */
+		free(right);
+		right = malloc((strlen(c) + 1) * sizeof(*right));
+		if (!right) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+
+		for (len = 0; ; ) {
+			if (*c == '|' || !*c) {
+				add_production(cg, lhs, right, len);
+				len = 0;
+				if (!*c)
+					break;
+				c++;
+				continue;
+			}
+			if (isspace((unsigned char)*c)) {
+				c++;
+				continue;
+			}
+			if (!parse_symbol(cg, &c, &right[len++])) {
+				fprintf(stderr, "%s:%u: too many "
+						"nonterminals\n", name,
+					line_no);
+				ret = false;
+				break;
+			}
+		}
+	}
+	free(right);
+	free(line);
+
+	if (ferror(stream)) {
+		perror(name);
+		ret = false;
+	}
+
+	if (ret && !*start) {
+		fprintf(stderr, "%s: no productions\n", name);
+		ret = false;
+	}
+
+	defined = calloc(cg->num_nonterms + 1, sizeof(*defined));
+	if (!defined) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < cg->num_productions; i++)
+		defined[NONTERM_INDEX(cg->productions[i].lhs)] = true;
+	for (i = 0; ret && i < cg->num_nonterms; i++) {
+		if (!defined[i]) {
+			fprintf(stderr, "%s: nonterminal %s has no "
+					"productions\n", name,
+				cg->names + cg->nonterm[i].name);
+			ret = false;
+		}
+	}
+	free(defined);
+
+	if (!ret) {
+		free_grammar(cg);
+		return false;
+	}
+
+	finish_grammar(cg);
+	return true;
+}
+
+/* Compiled grammars can be cached in a binary file.  Loading the cache is a
+ * handful of reads, there's nothing left to parse or to compute.  The cache
+ * is specific to the machine and the build that wrote it, the header
+ * detects mismatches.
+ */
+#define GRAMMAR_CACHE_MAGIC "PDAGRAM"
+#define GRAMMAR_CACHE_VERSION 5
+
+struct grammar_cache_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int production_size;
+	unsigned int nonterminal_size;
+	unsigned int num_productions;
+	unsigned int num_symbols;
+	unsigned int num_nonterms;
+	unsigned int names_used;
+	unsigned int num_prefix_chars;
+	symbol_t start;
+};
+
+#ifndef PDA_LIBRARY
+static bool save_grammar_cache(const char *name,
+			       const struct compiled_grammar *cg,
+			       symbol_t start)
+{
+	struct grammar_cache_header header = {
+		.magic = GRAMMAR_CACHE_MAGIC,
+		.version = GRAMMAR_CACHE_VERSION,
+		.production_size = sizeof(struct production),
+		.nonterminal_size = sizeof(struct nonterminal),
+		.num_productions = cg->num_productions,
+		.num_symbols = cg->num_symbols,
+		.num_nonterms = cg->num_nonterms,
+		.names_used = cg->names_used,
+		.num_prefix_chars = cg->num_prefix_chars,
+		.start = start,
+	};
+	bool ret;
+	FILE *f;
+
+	f = fopen(name, "wb");
+	if (!f) {
+		perror(name);
+		return false;
+	}
+
+	ret = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	      fwrite(cg->productions, sizeof(*cg->productions),
+		     cg->num_productions, f) == cg->num_productions &&
+	      fwrite(cg->symbols, sizeof(*cg->symbols),
+		     cg->num_symbols, f) == cg->num_symbols &&
+	      fwrite(cg->nonterm, sizeof(*cg->nonterm),
+		     cg->num_nonterms, f) == cg->num_nonterms &&
+	      fwrite(cg->names, 1, cg->names_used, f) == cg->names_used &&
+	      fwrite(cg->prefix_chars, 1, cg->num_prefix_chars, f) ==
+	      cg->num_prefix_chars;
+
+	if (fclose(f) || !ret) {
+		perror(name);
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+static bool valid_symbol(const struct compiled_grammar *cg, symbol_t symbol)
+{
+	return !is_nonterminal(symbol) ||
+	       NONTERM_INDEX(symbol) < cg->num_nonterms;
+}
+
+/* A cache is trusted no further than its header was checked.  Everything else
+ * that refers into an array must stay within it, as the engines never check
+ * again.
+ */
+static bool valid_grammar_cache(const struct compiled_grammar *cg,
+				symbol_t start)
+{
+	const struct production *p;
+	const struct nonterminal *nterm;
+	unsigned int i, j;
+
+	if (!is_nonterminal(start) || !valid_symbol(cg, start))
+		return false;
+
+	for (i = 0; i < cg->num_symbols; i++)
+		if (!valid_symbol(cg, cg->symbols[i]))
+			return false;
+
+	for (i = 0; i < cg->num_productions; i++) {
+		p = &cg->productions[i];
+		if (p->offset > cg->num_symbols ||
+		    p->len > cg->num_symbols - p->offset ||
+		    p->prefix > p->len ||
+		    p->prefix_offset > cg->num_prefix_chars ||
+		    p->prefix > cg->num_prefix_chars - p->prefix_offset ||
+		    !is_nonterminal(p->lhs) || !valid_symbol(cg, p->lhs))
+			return false;
+	}
+
+	/* The names are stored back to back, each with its NUL */
+	if (cg->num_nonterms &&
+	    (!cg->names_used || cg->names[cg->names_used - 1]))
+		return false;
+
+	for (i = 0; i < cg->num_nonterms; i++) {
+		nterm = &cg->nonterm[i];
+		if (nterm->first > cg->num_productions ||
+		    nterm->count > cg->num_productions - nterm->first ||
+		    nterm->name >= cg->names_used)
+			return false;
+		for (j = 0; j < nterm->count; j++)
+			if (cg->productions[nterm->first + j].lhs !=
+			    NONTERMINAL(i))
+				return false;
+	}
+
+	return true;
+}
+
+static bool read_grammar_cache(FILE *f, const char *name,
+			       struct compiled_grammar *cg, symbol_t *start)
+{
+	struct grammar_cache_header header;
+
+	memset(cg, 0, sizeof(*cg));
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, GRAMMAR_CACHE_MAGIC, sizeof(header.magic)) ||
+	    header.version != GRAMMAR_CACHE_VERSION ||
+	    header.production_size != sizeof(struct production) ||
+	    header.nonterminal_size != sizeof(struct nonterminal) ||
+	    header.num_nonterms > MAX_NONTERMS) {
+		fprintf(stderr, "%s: incompatible grammar cache\n", name);
+		return false;
+	}
+
+	cg->num_productions = cg->productions_size = header.num_productions;
+	cg->num_symbols = cg->symbols_size = header.num_symbols;
+	cg->num_nonterms = cg->nonterms_size = header.num_nonterms;
+	cg->names_used = cg->names_size = header.names_used;
+	cg->num_prefix_chars = header.num_prefix_chars;
+	cg->productions = malloc(cg->num_productions *
+				 sizeof(*cg->productions) + 1);
+	cg->symbols = malloc(cg->num_symbols * sizeof(*cg->symbols) + 1);
+	cg->nonterm = malloc(cg->num_nonterms * sizeof(*cg->nonterm) + 1);
+	cg->names = malloc(cg->names_used + 1);
+	cg->prefix_chars = malloc(cg->num_prefix_chars + 1);
+	if (!cg->productions || !cg->symbols || !cg->nonterm || !cg->names ||
+	    !cg->prefix_chars) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fread(cg->productions, sizeof(*cg->productions),
+		  cg->num_productions, f) != cg->num_productions ||
+	    fread(cg->symbols, sizeof(*cg->symbols),
+		  cg->num_symbols, f) != cg->num_symbols ||
+	    fread(cg->nonterm, sizeof(*cg->nonterm),
+		  cg->num_nonterms, f) != cg->num_nonterms ||
+	    fread(cg->names, 1, cg->names_used, f) != cg->names_used ||
+	    fread(cg->prefix_chars, 1, cg->num_prefix_chars, f) !=
+	    cg->num_prefix_chars) {
+		fprintf(stderr, "%s: truncated grammar cache\n", name);
+		free_grammar(cg);
+		return false;
+	}
+
+	if (!valid_grammar_cache(cg, header.start)) {
+		fprintf(stderr, "%s: corrupt grammar cache\n", name);
+		free_grammar(cg);
+		return false;
+	}
+
+	*start = header.start;
+	return true;
+}
+
+/* Load a grammar from a text file or from a grammar cache */
+static bool load_grammar(const char *name, struct compiled_grammar *cg,
+			 symbol_t *start)
+{
+	char magic[sizeof(GRAMMAR_CACHE_MAGIC)] = { 0 };
+	bool ret;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (!f) {
+		perror(name);
+		return false;
+	}
+
+	if (fread(magic, sizeof(magic), 1, f) == 1 &&
+	    !memcmp(magic, GRAMMAR_CACHE_MAGIC, sizeof(magic))) {
+		rewind(f);
+		ret = read_grammar_cache(f, name, cg, start);
+	} else {
+		rewind(f);
+		ret = parse_grammar(f, name, cg, start);
+	}
+	fclose(f);
+
+	return ret;
+}
+
+/* A production with its right side in natural (non-reversed) order.  The
+ * transformations of grammars below work on lists of them.
+ */
+struct plain_production {
+	symbol_t lhs;
+	unsigned int len;
+	symbol_t *right;
+};
+
+/* Left factoring.  If two productions of a nonterminal A start with the
+ * same symbol, an LL(1) parser can't decide between them.  For
+ *	A -> xyB | xyC | z
+ * we factor out the longest common prefix xy and introduce a fresh
+ * nonterminal <A'>:
+ *	A -> xy<A'> | z
+ *	<A'> -> B | C
+ * This is repeated until no two productions of a nonterminal share their
+ * first symbol.  The language stays the same.  Returns false if we run
+ * out of fresh nonterminals.
+ */
+
+/* Add a fresh nonterminal <name'>, with as many primes as it takes to make
+ * it unique.
+ */
+static symbol_t fresh_named_nonterminal(struct compiled_grammar *cg,
+					const char *name, unsigned int len)
+{
+	symbol_t symbol;
+	char *fresh;
+
+	fresh = malloc(len + 1);
+	if (!fresh) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	fresh[0] = '<';
+	memcpy(fresh + 1, name, len++);
+
+	/* Append primes until the name is unique */
+	do {
+		fresh = realloc(fresh, len + 2);
+		if (!fresh) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+		fresh[len++] = '\'';
+		fresh[len] = '>';
+	} while (find_nonterminal(cg, fresh, len + 1));
+
+	symbol = add_nonterminal(cg, fresh, len + 1);
+	free(fresh);
+
+	return symbol;
+}
+
+/* Add a fresh nonterminal derived from the name of nonterminal base */
+static symbol_t fresh_nonterminal(struct compiled_grammar *cg, symbol_t base)
+{
+	const char *name = nonterminal_name(cg, base);
+	unsigned int len = strlen(name);
+
+	/* Strip the angle brackets, if there are any */
+	if (name[0] == '<') {
+		name++;
+		len -= 2;
+	}
+
+	return fresh_named_nonterminal(cg, name, len);
+}
+
+static bool left_factor(const struct compiled_grammar *cg,
+			struct compiled_grammar *out)
+{
+	struct plain_production *prods, *a, *b;
+	unsigned int i, j, k, count, size, prefix;
+	bool ret = true, changed;
+	symbol_t fresh;
+
+	/* The factored grammar keeps all nonterminals of cg, with the same
+	 * symbols.  Fresh ones are added behind them.
+	 */
+	memset(out, 0, sizeof(*out));
+	for (i = 0; i < cg->num_nonterms; i++)
+		add_nonterminal(out, cg->names + cg->nonterm[i].name,
+				strlen(cg->names + cg->nonterm[i].name));
+
+	count = cg->num_productions;
+	size = count * 2 + 16;
+	prods = malloc(size * sizeof(*prods));
+	if (!prods) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Copy all productions in their natural (non-reversed) order */
+	for (i = 0; i < count; i++) {
+		const struct production *p = &cg->productions[i];
+
+		prods[i].lhs = p->lhs;
+		prods[i].len = p->len;
+		prods[i].right = malloc((p->len + 1) * sizeof(symbol_t));
+		if (!prods[i].right) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		for (j = 0; j < p->len; j++)
+			prods[i].right[j] = production_symbol(cg, p, j);
+	}
+
+	do {
+		changed = false;
+		for (i = 0; i < count && !changed; i++) {
+			a = &prods[i];
+			if (!a->len)
+				continue;
+
+			/* Find the longest prefix that a shares with any
+			 * other production of the same nonterminal that
+			 * starts with the same symbol.
+			 */
+			prefix = 0;
+			for (j = i + 1; j < count; j++) {
+				b = &prods[j];
+				if (b->lhs != a->lhs || !b->len ||
+				    b->right[0] != a->right[0])
+					continue;
+				for (k = 1; k < a->len && k < b->len; k++)
+					if (a->right[k] != b->right[k])
+						break;
+				if (!prefix || k < prefix)
+					prefix = k;
+			}
+			if (!prefix)
+				continue;
+
+			fresh = fresh_nonterminal(out, a->lhs);
+			if (!fresh) {
+				ret = false;
+				goto out;
+			}
+
+			/* Move the suffixes of all productions that share
+			 * the prefix over to the fresh nonterminal, and
+			 * replace the first of them by A -> prefix A'.
+			 */
+			for (j = i; j < count; j++) {
+				b = &prods[j];
+				if (b->lhs != a->lhs || b->len < prefix ||
+				    memcmp(b->right, a->right,
+					   prefix * sizeof(symbol_t)))
+					continue;
+
+				if (count == size) {
+					size *= 2;
+					prods = realloc(prods,
+							size * sizeof(*prods));
+					if (!prods) {
+						perror("realloc");
+						exit(EXIT_FAILURE);
+					}
+					a = &prods[i];
+					b = &prods[j];
+				}
+				prods[count].lhs = fresh;
+				prods[count].len = b->len - prefix;
+				prods[count].right = malloc((b->len - prefix + 1) *
+							    sizeof(symbol_t));
+				if (!prods[count].right) {
+					perror("malloc");
+					exit(EXIT_FAILURE);
+				}
+				memcpy(prods[count].right, b->right + prefix,
+				       (b->len - prefix) * sizeof(symbol_t));
+				count++;
+
+				if (j == i) {
+					a->right[prefix] = fresh;
+					a->len = prefix + 1;
+				} else {
+					/* Mark as deleted */
+					b->lhs = 0;
+				}
+			}
+
+			/* Compact the list of productions */
+			for (j = 0, k = 0; j < count; j++) {
+				if (prods[j].lhs)
+					prods[k++] = prods[j];
+				else
+					free(prods[j].right);
+			}
+			count = k;
+			changed = true;
+		}
+	} while (changed);
+
+	for (i = 0; i < count; i++)
+		add_production(out, prods[i].lhs, prods[i].right, prods[i].len);
+	finish_grammar(out);
+
+out:
+	for (i = 0; i < count; i++)
+		free(prods[i].right);
+	free(prods);
+	if (!ret)
+		free_grammar(out);
+
+	return ret;
+}
+
+/* Normalization.  Grammars that are written by hand tend to carry dead
+ * weight: nonterminals that don't derive any word at all, nonterminals that
+ * can't be reached from the start symbol, and unit productions A -> B that
+ * only cost the engines another expansion.  normalize_grammar() strips them
+ * once at load, and every engine works with the result:
+ *  1. Drop all non-generating nonterminals and every production that uses
+ *     one of them.  A nonterminal is generating iff its minimal yield is
+ *     finite.
+ *  2. Replace every unit production A -> B by the productions of B, which
+ *     are, in turn, freed of their unit productions.
+ *  3. Drop all nonterminals that can't be reached from the start symbol.
+ *  4. If asked to, inline a nonterminal that is used only once: for
+ *	A -> xBy  and  B -> u | v
+ *     we get A -> xuy | xvy, and B is gone.  Then repeat from 2.
+ * Finally, duplicate productions are dropped.
+ * The language stays the same.  Epsilon productions are kept: all engines
+ * deal with them, and removing them may blow up the grammar exponentially.
+ */
+struct production_list {
+	struct plain_production *prod;
+	unsigned int count, size;
+};
+
+/* Append a production with a right side of len symbols to list, and return
+ * the right side for the caller to fill in.
+ */
+static symbol_t *new_production(struct production_list *list, symbol_t lhs,
+				unsigned int len)
+{
+	struct plain_production *p;
+
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 64;
+		list->prod = realloc(list->prod,
+				     list->size * sizeof(*list->prod));
+		if (!list->prod) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	p = &list->prod[list->count++];
+	p->lhs = lhs;
+	p->len = len;
+	p->right = malloc((len + 1) * sizeof(symbol_t));
+	if (!p->right) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	return p->right;
+}
+
+static void free_production_list(struct production_list *list)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->count; i++)
+		free(list->prod[i].right);
+	free(list->prod);
+	memset(list, 0, sizeof(*list));
+}
+
+/* Sort list by the left sides, but keep the order of the productions of
+ * each nonterminal.  Afterwards, the productions of the nonterminal with
+ * index i start at first[i] and end before first[i + 1].
+ */
+static void sort_production_list(struct production_list *list,
+				 unsigned int num_nonterms, unsigned int *first)
+{
+	struct plain_production *sorted;
+	unsigned int i, *next;
+
+	sorted = malloc((list->count + 1) * sizeof(*sorted));
+	next = calloc(num_nonterms + 1, sizeof(*next));
+	if (!sorted || !next) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	memset(first, 0, (num_nonterms + 1) * sizeof(*first));
+	for (i = 0; i < list->count; i++)
+		first[NONTERM_INDEX(list->prod[i].lhs) + 1]++;
+	for (i = 0; i < num_nonterms; i++)
+		first[i + 1] += first[i];
+
+	memcpy(next, first, num_nonterms * sizeof(*next));
+	for (i = 0; i < list->count; i++) {
+		unsigned int nterm = NONTERM_INDEX(list->prod[i].lhs);
+
+		sorted[next[nterm]++] = list->prod[i];
+	}
+
+	free(list->prod);
+	free(next);
+	list->prod = sorted;
+	list->size = list->count + 1;
+}
+
+static bool is_unit_production(const struct plain_production *p)
+{
+	return p->len == 1 && is_nonterminal(p->right[0]);
+}
+
+/* Step 2: Replace all unit productions of in.  The productions that replace
+ * A -> B take its place, so the order in which the backtracker tries the
+ * productions stays the same.  Cycles like A -> B, B -> A are cut, as they
+ * don't add anything to the language.  Returns true if there was any unit
+ * production.
+ */
+static bool eliminate_unit_productions(struct production_list *in,
+				       unsigned int num_nonterms)
+{
+	struct unit_walk {
+		unsigned int nonterm, next;
+	} *walk;
+	struct production_list out = { 0 };
+	const struct plain_production *p;
+	unsigned int i, depth, *first, *seen;
+	bool changed = false;
+
+	first = malloc((num_nonterms + 1) * sizeof(*first));
+	walk = malloc(num_nonterms * sizeof(*walk));
+	seen = calloc(num_nonterms, sizeof(*seen));
+	if (!first || !walk || !seen) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	sort_production_list(in, num_nonterms, first);
+	for (i = 0; i < in->count && !changed; i++)
+		changed = is_unit_production(&in->prod[i]);
+	if (!changed)
+		goto out;
+
+	for (i = 0; i < num_nonterms; i++) {
+		/* Walk along the unit productions in depth-first order and
+		 * collect all other productions on the way.  seen[b] is
+		 * i + 1 iff we already came across b.
+		 */
+		seen[i] = i + 1;
+		walk[0].nonterm = i;
+		walk[0].next = first[i];
+		depth = 1;
+
+		while (depth) {
+			struct unit_walk *w = &walk[depth - 1];
+
+			if (w->next == first[w->nonterm + 1]) {
+				depth--;
+				continue;
+			}
+
+			p = &in->prod[w->next++];
+			if (!is_unit_production(p)) {
+				memcpy(new_production(&out, NONTERMINAL(i),
+						      p->len),
+				       p->right, p->len * sizeof(symbol_t));
+			} else if (seen[NONTERM_INDEX(p->right[0])] != i + 1) {
+				w = &walk[depth++];
+				w->nonterm = NONTERM_INDEX(p->right[0]);
+				w->next = first[w->nonterm];
+				seen[w->nonterm] = i + 1;
+			}
+		}
+	}
+
+	free_production_list(in);
+	*in = out;
+
+out:
+	free(first);
+	free(walk);
+	free(seen);
+
+	return changed;
+}
+
+/* Step 4: Inline one nonterminal, other than start, that is used exactly
+ * once.  Returns false if there is none.
+ */
+static bool inline_single_use(struct production_list *in,
+			      unsigned int num_nonterms, symbol_t start)
+{
+	struct production_list out = { 0 };
+	const struct plain_production *p, *b;
+	unsigned int i, j, *uses, user = 0;
+	symbol_t victim = 0, *right;
+
+	uses = calloc(num_nonterms, sizeof(*uses));
+	if (!uses) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < in->count; i++)
+		for (j = 0; j < in->prod[i].len; j++)
+			if (is_nonterminal(in->prod[i].right[j]))
+				uses[NONTERM_INDEX(in->prod[i].right[j])]++;
+
+	/* As the only use of the victim is not one of its own productions,
+	 * the victim is not recursive.
+	 */
+	for (i = 0; i < in->count && !victim; i++)
+		for (j = 0; j < in->prod[i].len; j++) {
+			symbol_t s = in->prod[i].right[j];
+
+			if (is_nonterminal(s) && s != start &&
+			    s != in->prod[i].lhs &&
+			    uses[NONTERM_INDEX(s)] == 1) {
+				victim = s;
+				user = i;
+				break;
+			}
+		}
+	free(uses);
+	if (!victim)
+		return false;
+
+	for (i = 0; i < in->count; i++) {
+		p = &in->prod[i];
+		if (p->lhs == victim)
+			continue;
+		if (i != user) {
+			memcpy(new_production(&out, p->lhs, p->len), p->right,
+			       p->len * sizeof(symbol_t));
+			continue;
+		}
+
+		for (j = 0; j < p->len && p->right[j] != victim; j++);
+		for (b = in->prod; b < in->prod + in->count; b++) {
+			if (b->lhs != victim)
+				continue;
+			right = new_production(&out, p->lhs,
+					       p->len - 1 + b->len);
+			memcpy(right, p->right, j * sizeof(symbol_t));
+			memcpy(right + j, b->right, b->len * sizeof(symbol_t));
+			memcpy(right + j + b->len, p->right + j + 1,
+			       (p->len - j - 1) * sizeof(symbol_t));
+		}
+	}
+
+	free_production_list(in);
+	*in = out;
+
+	return true;
+}
+
+static bool same_production(const struct plain_production *a,
+			    const struct plain_production *b)
+{
+	return a->lhs == b->lhs && a->len == b->len &&
+	       !memcmp(a->right, b->right, a->len * sizeof(symbol_t));
+}
+
+/* Mark all productions of the sorted list that occur twice as deleted, by
+ * setting their left side to 0.
+ */
+static void mark_duplicates(struct production_list *list,
+			    unsigned int num_nonterms,
+			    const unsigned int *first)
+{
+	unsigned int i, j, k;
+
+	for (i = 0; i < num_nonterms; i++)
+		for (j = first[i]; j < first[i + 1]; j++)
+			for (k = first[i]; k < j; k++)
+				if (same_production(&list->prod[k],
+						    &list->prod[j])) {
+					list->prod[j].lhs = 0;
+					break;
+				}
+}
+
+/* Step 3: Drop the productions of all nonterminals that can't be reached
+ * from start.  reachable tells which ones can.
+ */
+static void remove_unreachable(struct production_list *list,
+			       unsigned int num_nonterms, symbol_t start,
+			       bool *reachable)
+{
+	unsigned int i, j, k, *first, *todo, num_todo;
+	const struct plain_production *q;
+
+	first = malloc((num_nonterms + 1) * sizeof(*first));
+	todo = malloc(num_nonterms * sizeof(*todo));
+	if (!first || !todo) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	sort_production_list(list, num_nonterms, first);
+	memset(reachable, 0, num_nonterms * sizeof(*reachable));
+	reachable[NONTERM_INDEX(start)] = true;
+	todo[0] = NONTERM_INDEX(start);
+	num_todo = 1;
+	while (num_todo) {
+		i = todo[--num_todo];
+		for (j = first[i]; j < first[i + 1]; j++) {
+			q = &list->prod[j];
+			for (k = 0; k < q->len; k++) {
+				symbol_t s = q->right[k];
+
+				if (!is_nonterminal(s) ||
+				    reachable[NONTERM_INDEX(s)])
+					continue;
+				reachable[NONTERM_INDEX(s)] = true;
+				todo[num_todo++] = NONTERM_INDEX(s);
+			}
+		}
+	}
+
+	for (i = 0, j = 0; i < list->count; i++) {
+		if (reachable[NONTERM_INDEX(list->prod[i].lhs)])
+			list->prod[j++] = list->prod[i];
+		else
+			free(list->prod[i].right);
+	}
+	list->count = j;
+
+	free(first);
+	free(todo);
+}
+
+/* Normalize cg to out, see above.  The nonterminals of out keep their
+ * names, but not necessarily their symbols, so start is updated.
+ */
+static void normalize_grammar(const struct compiled_grammar *cg,
+			      symbol_t *start, bool inline_nonterms,
+			      struct compiled_grammar *out)
+{
+	unsigned int i, j, k, num_nonterms = cg->num_nonterms;
+	struct production_list list = { 0 };
+	const struct production *p;
+	struct plain_production *q;
+	symbol_t *map, *right;
+	unsigned int *first;
+	bool *reachable;
+
+	first = malloc((num_nonterms + 1) * sizeof(*first));
+	map = calloc(num_nonterms, sizeof(*map));
+	reachable = calloc(num_nonterms, sizeof(*reachable));
+	if (!first || !map || !reachable) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Step 1: Copy all productions that only use generating
+	 * nonterminals.
+	 */
+	for (i = 0; i < cg->num_productions; i++) {
+		p = &cg->productions[i];
+		if (nonterminal(cg, p->lhs)->min_yield == YIELD_INFINITE)
+			continue;
+		for (j = 0; j < p->len; j++) {
+			symbol_t s = production_symbol(cg, p, j);
+
+			if (is_nonterminal(s) &&
+			    nonterminal(cg, s)->min_yield == YIELD_INFINITE)
+				break;
+		}
+		if (j < p->len)
+			continue;
+
+		right = new_production(&list, p->lhs, p->len);
+		for (j = 0; j < p->len; j++)
+			right[j] = production_symbol(cg, p, j);
+	}
+
+	/* Steps 2 to 4.  Only reachable nonterminals count as used. */
+	do {
+		eliminate_unit_productions(&list, num_nonterms);
+		remove_unreachable(&list, num_nonterms, *start, reachable);
+	} while (inline_nonterms &&
+		 inline_single_use(&list, num_nonterms, *start));
+	sort_production_list(&list, num_nonterms, first);
+
+	/* Keep the reachable nonterminals in their original order. The
+	 * start symbol is kept in any case, even if its language is empty.
+	 */
+	memset(out, 0, sizeof(*out));
+	for (i = 0; i < num_nonterms; i++) {
+		const char *name = nonterminal_name(cg, NONTERMINAL(i));
+
+		if (reachable[i])
+			map[i] = add_nonterminal(out, name, strlen(name));
+	}
+
+	mark_duplicates(&list, num_nonterms, first);
+
+	for (i = 0; i < num_nonterms; i++) {
+		if (!reachable[i])
+			continue;
+		for (j = first[i]; j < first[i + 1]; j++) {
+			q = &list.prod[j];
+			if (!q->lhs)
+				continue;
+
+			for (k = 0; k < q->len; k++)
+				if (is_nonterminal(q->right[k]))
+					q->right[k] =
+						map[NONTERM_INDEX(q->right[k])];
+			add_production(out, map[i], q->right, q->len);
+		}
+	}
+	finish_grammar(out);
+	*start = map[NONTERM_INDEX(*start)];
+
+	free_production_list(&list);
+	free(first);
+	free(map);
+	free(reachable);
+}
+
+#ifndef PDA_LIBRARY
+/* Tell how much the grammar shrank */
+static void print_normalization(const struct compiled_grammar *before,
+				const struct compiled_grammar *after)
+{
+	fprintf(stderr, "Normalized grammar: %u -> %u nonterminals, "
+			"%u -> %u productions, %u -> %u symbols\n",
+		before->num_nonterms, after->num_nonterms,
+		before->num_productions, after->num_productions,
+		before->num_symbols, after->num_symbols);
+}
+#endif
+
+/* Calculate the FOLLOW sets of all nonterminals, i.e., the chars that may
+ * follow a nonterminal in a sentential form.  The start symbol can be
+ * followed by the end of the input.  follow has one set per nonterminal.
+ */
+static void calc_follow_sets(const struct compiled_grammar *cg,
+			     symbol_t start, struct charset *follow)
+{
+	const struct production *p;
+	struct charset set;
+	unsigned int i, j;
+	symbol_t symbol;
+	bool changed;
+
+	memset(follow, 0, cg->num_nonterms * sizeof(*follow));
+	charset_add(&follow[NONTERM_INDEX(start)], END_OF_INPUT);
+
+	do {
+		changed = false;
+		for (i = 0; i < cg->num_productions; i++) {
+			p = &cg->productions[i];
+			for (j = 0; j < p->len; j++) {
+				symbol = production_symbol(cg, p, j);
+				if (!is_nonterminal(symbol))
+					continue;
+
+				/* Whatever can start the rest of the
+				 * production follows the symbol.  If the rest
+				 * vanishes, so does whatever follows lhs.
+				 */
+				memset(&set, 0, sizeof(set));
+				if (first_of_suffix(cg, p, j + 1, &set))
+					charset_union(&set,
+						&follow[NONTERM_INDEX(p->lhs)]);
+				changed |= charset_union(
+					&follow[NONTERM_INDEX(symbol)], &set);
+			}
+		}
+	} while (changed);
+}
+
+static void print_char(FILE *stream, unsigned char c)
+{
+	if (c == END_OF_INPUT)
+		fprintf(stream, "end of input");
+	else if (isprint(c))
+		fprintf(stream, "'%c'", c);
+	else
+		fprintf(stream, "'\\x%02x'", c);
+}
+
+static void free_ll1(struct ll1 *ll1)
+{
+	free_grammar(&ll1->g);
+	free(ll1->table);
+}
+
+/* Build the LL(1) parse table for cg.  The grammar is left-factored first.
+ * For each production A -> w, the table selects it for every char that w can
+ * start with, and, if w is nullable, for every char that may follow A.  If
+ * two productions compete for the same entry, the grammar is not LL(1).  All
+ * such conflicts are reported on stderr.  Returns false if there was any.
+ */
+static bool build_ll1(const struct compiled_grammar *cg, symbol_t start,
+		      struct ll1 *ll1)
+{
+	struct charset *follow, set;
+	const struct production *p;
+	unsigned int i, c, nterm;
+	bool ret = true;
+	int *entry;
+
+	if (!left_factor(cg, &ll1->g)) {
+		fprintf(stderr, "LL(1): out of nonterminals for left "
+				"factoring\n");
+		return false;
+	}
+
+	follow = malloc(ll1->g.num_nonterms * sizeof(*follow) + 1);
+	ll1->table = malloc(ll1->g.num_nonterms * sizeof(*ll1->table) + 1);
+	if (!follow || !ll1->table) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	calc_follow_sets(&ll1->g, start, follow);
+	memset(ll1->table, -1, ll1->g.num_nonterms * sizeof(*ll1->table));
+
+	for (i = 0; i < ll1->g.num_productions; i++) {
+		p = &ll1->g.productions[i];
+		nterm = NONTERM_INDEX(p->lhs);
+
+		memset(&set, 0, sizeof(set));
+		if (first_of_suffix(&ll1->g, p, 0, &set))
+			charset_union(&set, &follow[nterm]);
+
+		for (c = 0; c < NUM_TERMINALS; c++) {
+			if (!charset_has(&set, c))
+				continue;
+
+			entry = &ll1->table[nterm][c];
+			if (*entry >= 0) {
+				fprintf(stderr, "LL(1) conflict on ");
+				print_char(stderr, c);
+				fprintf(stderr, ": ");
+				print_production(stderr, &ll1->g,
+						 &ll1->g.productions[*entry]);
+				fprintf(stderr, " vs. ");
+				print_production(stderr, &ll1->g, p);
+				fprintf(stderr, "\n");
+				ret = false;
+				continue;
+			}
+			*entry = i;
+		}
+	}
+	free(follow);
+
+	if (!ret)
+		free_ll1(ll1);
+
+	return ret;
+}
+
+/* LR parsing.  An item A -> u.v of the grammar tells that the PDA has seen
+ * a word that derives from u, and hopes for one that derives from v.  The
+ * states of the PDA are sets of items: the kernel items, which the PDA got
+ * to by shifting a symbol, together with their closure, i.e., B -> .w for
+ * every B that directly follows a dot.  In every state, the PDA may
+ *  - shift the next symbol X, and move to the state of all items with the
+ *    dot advanced over X, or
+ *  - reduce by A -> w, if an item A -> w. is complete and the next char may
+ *    follow A (that's the "S" of SLR),
+ * and if both apply to some char, or two reductions do, the grammar is not
+ * SLR(1).  An extra production S' -> S, for the start symbol S, accepts the
+ * word once it's complete, and it's the only item of the first state.
+ */
+struct lr_item {
+	unsigned int production;
+	unsigned int dot;
+};
+
+/* An item with the dot advanced over symbol, on the way to the next state */
+struct lr_move {
+	symbol_t symbol;
+	struct lr_item item;
+};
+
+/* The sets of items that were found so far.  The kernel of state i are the
+ * items from kernel_first[i] to kernel_first[i + 1], and hash maps kernels
+ * to their state + 1.
+ */
+struct lr_item_sets {
+	struct lr_item *kernels;
+	unsigned int num_kernels;
+	unsigned int kernels_size;
+	unsigned int *kernel_first;
+
+	unsigned int *hash;
+	unsigned int hash_size;
+
+	/* The number of states that the tables have room for */
+	unsigned int size;
+};
+
+/* Get the symbol after the dot of item, if there is one.  S' -> S has the
+ * number of the productions as its index.
+ */
+static bool lr_next_symbol(const struct compiled_grammar *cg, symbol_t start,
+			   const struct lr_item *item, symbol_t *symbol)
+{
+	const struct production *p;
+
+	if (item->production == cg->num_productions) {
+		*symbol = start;
+		return item->dot == 0;
+	}
+
+	p = &cg->productions[item->production];
+	if (item->dot == p->len)
+		return false;
+	*symbol = production_symbol(cg, p, item->dot);
+	return true;
+}
+
+static int compare_lr_moves(const void *a, const void *b)
+{
+	const struct lr_move *x = a, *y = b;
+
+	if (x->symbol != y->symbol)
+		return x->symbol < y->symbol ? -1 : 1;
+	if (x->item.production != y->item.production)
+		return x->item.production < y->item.production ? -1 : 1;
+	return x->item.dot < y->item.dot ? -1 : x->item.dot > y->item.dot;
+}
+
+static unsigned int hash_lr_kernel(const struct lr_item *kernel,
+				   unsigned int count)
+{
+	unsigned int i, hash = 2166136261U;
+
+	for (i = 0; i < count; i++) {
+		hash = (hash ^ kernel[i].production) * 16777619U;
+		hash = (hash ^ kernel[i].dot) * 16777619U;
+	}
+
+	return hash;
+}
+
+static void lr_hash_insert(struct lr_item_sets *sets, unsigned int state)
+{
+	unsigned int h;
+
+	h = hash_lr_kernel(sets->kernels + sets->kernel_first[state],
+			   sets->kernel_first[state + 1] -
+			   sets->kernel_first[state]);
+	while (sets->hash[h & (sets->hash_size - 1)])
+		h++;
+	sets->hash[h & (sets->hash_size - 1)] = state + 1;
+}
+
+/* Find the state with the given kernel, or add a new one to lr */
+static unsigned int lr_state(struct lr *lr, struct lr_item_sets *sets,
+			     const struct lr_item *kernel, unsigned int count)
+{
+	unsigned int h, i, state;
+
+	for (h = hash_lr_kernel(kernel, count);; h++) {
+		state = sets->hash[h & (sets->hash_size - 1)];
+		if (!state)
+			break;
+		state--;
+		if (sets->kernel_first[state + 1] -
+		    sets->kernel_first[state] == count &&
+		    !memcmp(sets->kernels + sets->kernel_first[state],
+			    kernel, count * sizeof(*kernel)))
+			return state;
+	}
+
+	state = lr->num_states++;
+	if (sets->num_kernels + count > sets->kernels_size) {
+		while (sets->num_kernels + count > sets->kernels_size)
+			sets->kernels_size = sets->kernels_size ?
+					       sets->kernels_size * 2 : 1024;
+		sets->kernels = realloc(sets->kernels,
+					  sets->kernels_size *
+					  sizeof(*sets->kernels));
+	}
+	sets->kernel_first = realloc(sets->kernel_first,
+				       (state + 2) *
+				       sizeof(*sets->kernel_first));
+	if (!sets->kernels || !sets->kernel_first) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(sets->kernels + sets->num_kernels, kernel,
+	       count * sizeof(*kernel));
+	sets->kernel_first[state] = sets->num_kernels;
+	sets->num_kernels += count;
+	sets->kernel_first[state + 1] = sets->num_kernels;
+
+	/* Keep the hash table at most half full */
+	if (lr->num_states * 2 > sets->hash_size) {
+		free(sets->hash);
+		sets->hash_size *= 2;
+		sets->hash = calloc(sets->hash_size,
+				      sizeof(*sets->hash));
+		if (!sets->hash) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < lr->num_states; i++)
+			lr_hash_insert(sets, i);
+	} else {
+		lr_hash_insert(sets, state);
+	}
+
+	/* The new state has no actions yet */
+	if (lr->num_states > sets->size) {
+		sets->size = sets->size ? sets->size * 2 : 64;
+		lr->action = realloc(lr->action,
+				     sets->size * sizeof(*lr->action));
+		lr->goto_state = realloc(lr->goto_state,
+					 (size_t)sets->size *
+					 lr->num_nonterms *
+					 sizeof(*lr->goto_state) + 1);
+		if (!lr->action || !lr->goto_state) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memset(lr->action[state], 0, sizeof(*lr->action));
+	memset(lr->goto_state + (size_t)state * lr->num_nonterms, -1,
+	       lr->num_nonterms * sizeof(*lr->goto_state));
+
+	return state;
+}
+
+static void print_lr_action(const struct compiled_grammar *cg, int action)
+{
+	if (action > 0) {
+		fprintf(stderr, "shift");
+	} else if (action == LR_ACCEPT) {
+		fprintf(stderr, "accept");
+	} else {
+		fprintf(stderr, "reduce ");
+		print_production(stderr, cg, &cg->productions[-action - 2]);
+	}
+}
+
+/* Enter action into the table, unless there's another one already */
+static bool set_lr_action(const struct compiled_grammar *cg, struct lr *lr,
+			  unsigned int state, unsigned char c, int action)
+{
+	int *entry = &lr->action[state][c];
+
+	if (*entry == LR_ERROR || *entry == action) {
+		*entry = action;
+		return true;
+	}
+
+	fprintf(stderr, "SLR(1) conflict in state %u on ", state);
+	print_char(stderr, c);
+	fprintf(stderr, ": ");
+	print_lr_action(cg, *entry);
+	fprintf(stderr, " vs. ");
+	print_lr_action(cg, action);
+	fprintf(stderr, "\n");
+	return false;
+}
+
+static void free_lr(struct lr *lr)
+{
+	free(lr->action);
+	free(lr->goto_state);
+	free(lr->reduction);
+}
+
+/* Build the SLR(1) tables for cg, see above.  The states are numbered in the
+ * order in which they are found, and every state is completed before the
+ * next one: its closure tells all of its actions.  All conflicts are
+ * reported on stderr.  Returns false if there was any.
+ */
+static bool build_lr(const struct compiled_grammar *cg, symbol_t start,
+		     struct lr *lr)
+{
+	const struct lr_item first = { cg->num_productions, 0 };
+	unsigned int i, j, k, c, state, num_closure, num_moves, *added;
+	unsigned int max_items;
+	struct lr_item_sets sets = { 0 };
+	const struct nonterminal *nterm;
+	struct lr_item *closure, *kernel;
+	struct charset *follow;
+	struct lr_move *moves;
+	bool ret = true;
+	symbol_t symbol;
+
+	memset(lr, 0, sizeof(*lr));
+	lr->num_nonterms = cg->num_nonterms;
+
+	/* A state holds every item at most once: there are len + 1 items for
+	 * a production of len symbols, and two for S' -> S.
+	 */
+	max_items = cg->num_symbols + cg->num_productions + 2;
+	closure = malloc(max_items * sizeof(*closure));
+	kernel = malloc(max_items * sizeof(*kernel));
+	moves = malloc(max_items * sizeof(*moves));
+	added = calloc(cg->num_nonterms + 1, sizeof(*added));
+	follow = malloc(cg->num_nonterms * sizeof(*follow) + 1);
+	sets.hash_size = 1024;
+	sets.hash = calloc(sets.hash_size, sizeof(*sets.hash));
+	lr->reduction = malloc((cg->num_productions + 1) *
+			       sizeof(*lr->reduction));
+	if (!closure || !kernel || !moves || !added || !follow ||
+	    !sets.hash || !lr->reduction) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	calc_follow_sets(cg, start, follow);
+	for (i = 0; i < cg->num_productions; i++) {
+		lr->reduction[i].len = cg->productions[i].len;
+		lr->reduction[i].nonterm =
+			NONTERM_INDEX(cg->productions[i].lhs);
+	}
+
+	lr_state(lr, &sets, &first, 1);
+	for (i = 0; i < lr->num_states; i++) {
+		/* The closure of the kernel.  added[] remembers which
+		 * nonterminals' items are in there already.
+		 */
+		num_closure = sets.kernel_first[i + 1] -
+			      sets.kernel_first[i];
+		memcpy(closure, sets.kernels + sets.kernel_first[i],
+		       num_closure * sizeof(*closure));
+		for (j = 0; j < num_closure; j++) {
+			if (!lr_next_symbol(cg, start, &closure[j], &symbol) ||
+			    !is_nonterminal(symbol) ||
+			    added[NONTERM_INDEX(symbol)] == i + 1)
+				continue;
+
+			added[NONTERM_INDEX(symbol)] = i + 1;
+			nterm = nonterminal(cg, symbol);
+			for (k = 0; k < nterm->count; k++) {
+				closure[num_closure].production =
+					nterm->first + k;
+				closure[num_closure++].dot = 0;
+			}
+		}
+
+		/* Group the items by their next symbol: each group is the
+		 * kernel of the state that shifting the symbol leads to.
+		 */
+		num_moves = 0;
+		for (j = 0; j < num_closure; j++) {
+			if (!lr_next_symbol(cg, start, &closure[j], &symbol))
+				continue;
+			moves[num_moves].symbol = symbol;
+			moves[num_moves].item = closure[j];
+			moves[num_moves++].item.dot++;
+		}
+		qsort(moves, num_moves, sizeof(*moves), compare_lr_moves);
+
+		for (j = 0; j < num_moves; j = k) {
+			for (k = j; k < num_moves &&
+			     moves[k].symbol == moves[j].symbol; k++)
+				kernel[k - j] = moves[k].item;
+
+			state = lr_state(lr, &sets, kernel, k - j);
+			if (is_nonterminal(moves[j].symbol))
+				lr->goto_state[(size_t)i * lr->num_nonterms +
+					       NONTERM_INDEX(moves[j].symbol)] =
+					state;
+			else
+				ret &= set_lr_action(cg, lr, i,
+						     moves[j].symbol,
+						     LR_SHIFT(state));
+		}
+
+		/* Reduce by the complete items */
+		for (j = 0; j < num_closure; j++) {
+			if (lr_next_symbol(cg, start, &closure[j], &symbol))
+				continue;
+			if (closure[j].production == cg->num_productions) {
+				ret &= set_lr_action(cg, lr, i, END_OF_INPUT,
+						     LR_ACCEPT);
+				continue;
+			}
+
+			symbol = cg->productions[closure[j].production].lhs;
+			for (c = 0; c < NUM_TERMINALS; c++)
+				if (charset_has(&follow[NONTERM_INDEX(symbol)],
+						c))
+					ret &= set_lr_action(cg, lr, i, c,
+						LR_REDUCE(closure[j].production));
+		}
+	}
+
+	free(sets.kernels);
+	free(sets.kernel_first);
+	free(sets.hash);
+	free(closure);
+	free(kernel);
+	free(moves);
+	free(added);
+	free(follow);
+
+	if (!ret)
+		free_lr(lr);
+
+	return ret;
+}
+
+/* Chomsky normal form.  Every production of a grammar in CNF is either A -> BC
+ * or A -> c.  We get there from the normalized grammar in four steps:
+ *  1. TERM: Replace every terminal c in right sides of two or more symbols
+ *     by a fresh nonterminal <c'> -> c.
+ *  2. BIN: Split right sides of more than two symbols: A -> XYZ becomes
+ *     A -> X<A'> and <A'> -> YZ.
+ *  3. DEL: Drop all epsilon productions.  For every A -> XY with a nullable
+ *     X, add A -> Y, and vice versa.  The empty word is lost on the way,
+ *     the caller has to remember whether the start symbol was nullable.
+ *  4. UNIT: Eliminate the unit productions this left, see step 2 of the
+ *     normalization.
+ * As BIN comes before DEL, the grammar grows at most linearly.  Returns
+ * false if we run out of fresh nonterminals.
+ */
+static bool cnf_grammar(const struct compiled_grammar *cg, symbol_t *start,
+			struct compiled_grammar *out)
+{
+	unsigned int i, j, num_nonterms, *first;
+	struct production_list list = { 0 }, del = { 0 };
+	symbol_t term[NUM_TERMINALS] = { 0 }, fresh, *right;
+	struct compiled_grammar normalized;
+	struct plain_production *p;
+	bool *nullables, *reachable, changed, ret = false;
+	char terminal[8];
+
+	normalize_grammar(cg, start, false, &normalized);
+
+	/* The CNF grammar keeps the nonterminals of the normalized one, with
+	 * the same symbols.
+	 */
+	memset(out, 0, sizeof(*out));
+	for (i = 0; i < normalized.num_nonterms; i++) {
+		const char *name = nonterminal_name(&normalized,
+						    NONTERMINAL(i));
+
+		add_nonterminal(out, name, strlen(name));
+	}
+
+	for (i = 0; i < normalized.num_productions; i++) {
+		const struct production *q = &normalized.productions[i];
+
+		right = new_production(&list, q->lhs, q->len);
+		for (j = 0; j < q->len; j++)
+			right[j] = production_symbol(&normalized, q, j);
+	}
+
+	/* Step 1.  new_production() may move the list, hence the indices. */
+	for (i = 0; i < list.count; i++) {
+		if (list.prod[i].len < 2)
+			continue;
+		for (j = 0; j < list.prod[i].len; j++) {
+			symbol_t c = list.prod[i].right[j];
+
+			if (is_nonterminal(c))
+				continue;
+			if (!term[c]) {
+				if (isalnum(c))
+					sprintf(terminal, "%c", c);
+				else
+					sprintf(terminal, "x%02x", c);
+				term[c] = fresh_named_nonterminal(out,
+						terminal, strlen(terminal));
+				if (!term[c])
+					goto out;
+				*new_production(&list, term[c], 1) = c;
+			}
+			list.prod[i].right[j] = term[c];
+		}
+	}
+
+	/* Step 2.  The tails land at the end of the list and are split in
+	 * turn.
+	 */
+	for (i = 0; i < list.count; i++) {
+		if (list.prod[i].len <= 2)
+			continue;
+
+		fresh = fresh_nonterminal(out, list.prod[i].lhs);
+		if (!fresh)
+			goto out;
+		right = new_production(&list, fresh, list.prod[i].len - 1);
+		p = &list.prod[i];
+		memcpy(right, p->right + 1, (p->len - 1) * sizeof(symbol_t));
+		p->right[1] = fresh;
+		p->len = 2;
+	}
+
+	/* Step 3 */
+	num_nonterms = out->num_nonterms;
+	nullables = calloc(num_nonterms, sizeof(*nullables));
+	reachable = calloc(num_nonterms, sizeof(*reachable));
+	first = malloc((num_nonterms + 1) * sizeof(*first));
+	if (!nullables || !reachable || !first) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	do {
+		changed = false;
+		for (i = 0; i < list.count; i++) {
+			p = &list.prod[i];
+			if (nullables[NONTERM_INDEX(p->lhs)])
+				continue;
+			for (j = 0; j < p->len; j++)
+				if (!is_nonterminal(p->right[j]) ||
+				    !nullables[NONTERM_INDEX(p->right[j])])
+					break;
+			if (j == p->len) {
+				nullables[NONTERM_INDEX(p->lhs)] = true;
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	for (i = 0; i < list.count; i++) {
+		p = &list.prod[i];
+		if (!p->len)
+			continue;
+		memcpy(new_production(&del, p->lhs, p->len), p->right,
+		       p->len * sizeof(symbol_t));
+		if (p->len == 1)
+			continue;
+		for (j = 0; j < 2; j++)
+			if (is_nonterminal(p->right[j]) &&
+			    nullables[NONTERM_INDEX(p->right[j])])
+				*new_production(&del, p->lhs, 1) =
+					p->right[1 - j];
+	}
+	free_production_list(&list);
+	list = del;
+
+	/* Step 4, and clean up what may have become unreachable */
+	eliminate_unit_productions(&list, num_nonterms);
+	remove_unreachable(&list, num_nonterms, *start, reachable);
+	sort_production_list(&list, num_nonterms, first);
+	mark_duplicates(&list, num_nonterms, first);
+
+	for (i = 0; i < list.count; i++)
+		if (list.prod[i].lhs)
+			add_production(out, list.prod[i].lhs,
+				       list.prod[i].right, list.prod[i].len);
+	finish_grammar(out);
+	ret = true;
+
+	free(nullables);
+	free(reachable);
+	free(first);
+out:
+	free_production_list(&list);
+	free_grammar(&normalized);
+	if (!ret)
+		free_grammar(out);
+
+	return ret;
+}
+
+static void free_cyk(struct cyk *cyk)
+{
+	free_grammar(&cyk->g);
+	free(cyk->terminal);
+	free(cyk->rights);
+	free(cyk->first_pair);
+	free(cyk->pair_right);
+	free(cyk->pair_heads);
+}
+
+static void bitset_add(unsigned long *set, unsigned int i)
+{
+	set[i / CHARSET_WORD_BITS] |= 1UL << (i % CHARSET_WORD_BITS);
+}
+
+static bool bitset_has(const unsigned long *set, unsigned int i)
+{
+	return set[i / CHARSET_WORD_BITS] & (1UL << (i % CHARSET_WORD_BITS));
+}
+
+/* Convert cg to CNF and build the tables of the CYK recognizer.  The binary
+ * productions A -> BC are grouped by B, and within the group by C: for each
+ * pair (B, C), pair_heads holds the set of all A.  rights[B] is the set of
+ * all C that B is paired with.  Returns false if cg can't be converted.
+ */
+static bool build_cyk(const struct compiled_grammar *cg, symbol_t start,
+		      struct cyk *cyk)
+{
+	unsigned int i, j, b, c, num_nonterms, num_pairs = 0;
+	unsigned int *order, *count, *pair_of;
+	const struct production *p;
+	unsigned int *seen;
+	size_t words;
+
+	memset(cyk, 0, sizeof(*cyk));
+	cyk->start = start;
+	cyk->empty = nullable(cg, start);
+	if (!cnf_grammar(cg, &cyk->start, &cyk->g)) {
+		fprintf(stderr, "CYK: out of nonterminals for the Chomsky "
+				"normal form\n");
+		return false;
+	}
+
+	num_nonterms = cyk->g.num_nonterms;
+	cyk->set_words = (num_nonterms + CHARSET_WORD_BITS - 1) /
+			 CHARSET_WORD_BITS;
+	words = cyk->set_words;
+
+	cyk->terminal = calloc(NUM_TERMINALS * words, sizeof(unsigned long));
+	cyk->rights = calloc(num_nonterms * words + 1, sizeof(unsigned long));
+	cyk->first_pair = calloc(num_nonterms + 1, sizeof(unsigned int));
+	cyk->pair_right = malloc((cyk->g.num_productions + 1) *
+				 sizeof(unsigned int));
+	cyk->pair_heads = calloc(cyk->g.num_productions * words + 1,
+				 sizeof(unsigned long));
+	order = malloc((cyk->g.num_productions + 1) * sizeof(*order));
+	count = calloc(num_nonterms + 1, sizeof(*count));
+	pair_of = malloc((num_nonterms + 1) * sizeof(*pair_of));
+	seen = calloc(num_nonterms + 1, sizeof(*seen));
+	if (!cyk->terminal || !cyk->rights || !cyk->first_pair ||
+	    !cyk->pair_right || !cyk->pair_heads || !order || !count ||
+	    !pair_of || !seen) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Sort the binary productions by B */
+	for (i = 0; i < cyk->g.num_productions; i++) {
+		p = &cyk->g.productions[i];
+		b = production_symbol(&cyk->g, p, 0);
+		if (p->len == 1)
+			bitset_add(&cyk->terminal[b * words],
+				   NONTERM_INDEX(p->lhs));
+		else
+			count[NONTERM_INDEX(b) + 1]++;
+	}
+	for (i = 0; i < num_nonterms; i++)
+		count[i + 1] += count[i];
+	for (i = 0; i < cyk->g.num_productions; i++) {
+		p = &cyk->g.productions[i];
+		b = production_symbol(&cyk->g, p, 0);
+		if (p->len == 2)
+			order[count[NONTERM_INDEX(b)]++] = i;
+	}
+
+	/* count[b] now is where the productions of b + 1 start */
+	for (b = 0, i = 0; b < num_nonterms; b++) {
+		cyk->first_pair[b] = num_pairs;
+		for (; i < count[b]; i++) {
+			p = &cyk->g.productions[order[i]];
+			c = NONTERM_INDEX(production_symbol(&cyk->g, p, 1));
+			if (seen[c] != b + 1) {
+				seen[c] = b + 1;
+				pair_of[c] = num_pairs;
+				cyk->pair_right[num_pairs++] = c;
+				bitset_add(&cyk->rights[b * words], c);
+			}
+			j = pair_of[c];
+			bitset_add(&cyk->pair_heads[j * words],
+				   NONTERM_INDEX(p->lhs));
+		}
+	}
+	cyk->first_pair[num_nonterms] = num_pairs;
+
+	free(order);
+	free(count);
+	free(pair_of);
+	free(seen);
+
+	return true;
+}
+
+/* FNV-1a over two words, folded so the high bits matter for the slot, too */
+static unsigned long memo_hash(unsigned long a, unsigned long b)
+{
+	unsigned long hash = 2166136261UL;
+
+	hash = (hash ^ a) * 16777619UL;
+	hash = (hash ^ b) * 16777619UL;
+
+	return hash ^ (hash >> 16);
+}
+
+/* Let an array of the memo grow from old_bytes to new_bytes.  Returns false
+ * if the memo would take more than MEMO_MAX_MEMORY.
+ */
+static bool memo_account(struct memo *memo, size_t old_bytes,
+			 size_t new_bytes)
+{
+	if (memo->memory - old_bytes + new_bytes > MEMO_MAX_MEMORY)
+		return false;
+
+	memo->memory += new_bytes - old_bytes;
+	return true;
+}
+
+/* The slot of node_table that holds the node of symbol on top of the stack
+ * below, or the free slot where it belongs.  The table never gets full.
+ */
+static unsigned int *memo_node_slot(struct memo *memo, unsigned int below,
+				    symbol_t symbol)
+{
+	const unsigned int mask = memo->node_table_size - 1;
+	const struct memo_node *node;
+	unsigned int i, *slot;
+
+	for (i = memo_hash(below, symbol) & mask; ; i = (i + 1) & mask) {
+		slot = &memo->node_table[i];
+		if (!*slot)
+			return slot;
+		node = &memo->nodes[*slot - 1];
+		if (node->below == below && node->symbol == symbol)
+			return slot;
+	}
+}
+
+static bool memo_grow_nodes(struct memo *memo)
+{
+	const struct memo_node *node;
+	unsigned int *old = memo->node_table, old_size = memo->node_table_size;
+	unsigned int i, size = old_size ? old_size * 2 : 1024;
+
+	if (!memo_account(memo, old_size * sizeof(*old), size * sizeof(*old)))
+		return false;
+
+	memo->node_table = calloc(size, sizeof(*memo->node_table));
+	if (!memo->node_table) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	memo->node_table_size = size;
+
+	/* All nodes are distinct, so memo_node_slot() finds a free slot for
+	 * each.
+	 */
+	for (i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		node = &memo->nodes[old[i] - 1];
+		*memo_node_slot(memo, node->below, node->symbol) = old[i];
+	}
+	free(old);
+
+	return true;
+}
+
+/* Add the node of symbol on top of the stack below.  Nodes are numbered from
+ * 1, as 0 is the empty stack.  Returns 0 if the memo is full.
+ */
+static unsigned int memo_add_node(struct memo *memo, unsigned int below,
+				  symbol_t symbol)
+{
+	struct memo_node *node;
+	unsigned int *slot, size;
+
+	/* Keep the load factor below 1/2 */
+	if (2 * (memo->num_nodes + 1) > memo->node_table_size &&
+	    !memo_grow_nodes(memo))
+		return 0;
+
+	if (memo->num_nodes == memo->nodes_size) {
+		size = memo->nodes_size ? memo->nodes_size * 2 : 1024;
+		if (!memo_account(memo, memo->nodes_size * sizeof(*node),
+				  size * sizeof(*node)))
+			return 0;
+		memo->nodes = realloc(memo->nodes, size * sizeof(*node));
+		if (!memo->nodes) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+		memo->nodes_size = size;
+	}
+
+	slot = memo_node_slot(memo, below, symbol);
+	node = &memo->nodes[memo->num_nodes++];
+	node->below = below;
+	node->symbol = symbol;
+	*slot = memo->num_nodes;
+
+	return *slot;
+}
+
+/* The backtracker rewrote the stack from height on */
+static inline void memo_forget(struct memo *memo, unsigned int height)
+{
+	if (memo->known > height)
+		memo->known = height;
+}
+
+/* Look up the nodes of the stack from known up to its top.  Unless add is
+ * set, we stop at the first stack that isn't interned, as no entry can refer
+ * to it, or to any stack above.  Returns false if the memo is full.
+ */
+static bool memo_intern(struct memo *memo, const struct stack *stack,
+			bool add)
+{
+	unsigned int i, below, id, size;
+
+	if (stack->top > memo->ids_size) {
+		size = memo->ids_size ? memo->ids_size : 1024;
+		while (size < stack->top)
+			size *= 2;
+		if (!memo_account(memo, memo->ids_size * sizeof(*memo->ids),
+				  size * sizeof(*memo->ids)))
+			return false;
+		memo->ids = realloc(memo->ids, size * sizeof(*memo->ids));
+		if (!memo->ids) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+		memo->ids_size = size;
+	}
+
+	for (i = memo->known; i < stack->top; i++) {
+		below = i ? memo->ids[i - 1] : MEMO_EMPTY_STACK;
+		id = memo->num_nodes ?
+		     *memo_node_slot(memo, below, stack->content[i]) : 0;
+		if (!id) {
+			if (!add)
+				return true;
+			id = memo_add_node(memo, below, stack->content[i]);
+			if (!id)
+				return false;
+		}
+		memo->ids[i] = id;
+		memo->known = i + 1;
+	}
+
+	return true;
+}
+
+static struct memo_entry *memo_slot(struct memo *memo, const char *word,
+				    unsigned int stack)
+{
+	const unsigned int mask = memo->size - 1;
+	struct memo_entry *entry;
+	unsigned int i;
+
+	/* Linear probing.  The table never gets full, so we always either
+	 * find our configuration or an empty slot.
+	 */
+	for (i = memo_hash((unsigned long)word, stack) & mask; ;
+	     i = (i + 1) & mask) {
+		entry = &memo->entries[i];
+		if (!entry->word ||
+		    (entry->word == word && entry->stack == stack))
+			return entry;
+	}
+}
+
+static bool memo_known_failure(struct memo *memo, const char *word,
+			       const struct stack *stack)
+{
+	if (!memo->used)
+		return false;
+
+	if (!memo_intern(memo, stack, false) || memo->known < stack->top)
+		return false;
+
+	return memo_slot(memo, word, memo->ids[stack->top - 1])->word != NULL;
+}
+
+/* Returns false if the table can't grow any further */
+static bool memo_grow(struct memo *memo)
+{
+	struct memo_entry *old = memo->entries;
+	unsigned int i, old_size = memo->size;
+	unsigned int size = old_size ? old_size * 2 : 1024;
+
+	if (!memo_account(memo, old_size * sizeof(*old), size * sizeof(*old)))
+		return false;
+
+	memo->entries = calloc(size, sizeof(*memo->entries));
+	if (!memo->entries) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	memo->size = size;
+
+	/* All entries are distinct, so memo_slot() finds a free slot for
+	 * each.
+	 */
+	for (i = 0; i < old_size; i++)
+		if (old[i].word)
+			*memo_slot(memo, old[i].word, old[i].stack) = old[i];
+	free(old);
+
+	return true;
+}
+
+/* Returns false if the memo is full */
+static bool memo_add_failure(struct memo *memo, const char *word,
+			     const struct stack *stack)
+{
+	struct memo_entry *entry;
+
+	/* Keep the load factor below 1/2 */
+	if (2 * (memo->used + 1) > memo->size && !memo_grow(memo))
+		return false;
+
+	if (!memo_intern(memo, stack, true))
+		return false;
+
+	entry = memo_slot(memo, word, memo->ids[stack->top - 1]);
+	if (!entry->word) {
+		entry->word = word;
+		entry->stack = memo->ids[stack->top - 1];
+		memo->used++;
+	}
+
+	return true;
+}
+
+/* Forget all configurations, but keep the memory for the next word */
+static void memo_clear(struct memo *memo)
+{
+	if (memo->used)
+		memset(memo->entries, 0, memo->size * sizeof(*memo->entries));
+	if (memo->num_nodes)
+		memset(memo->node_table, 0,
+		       memo->node_table_size * sizeof(*memo->node_table));
+	memo->used = 0;
+	memo->num_nodes = 0;
+	memo->known = 0;
+}
+
+static void memo_free(struct memo *memo)
+{
+	free(memo->entries);
+	free(memo->nodes);
+	free(memo->node_table);
+	free(memo->ids);
+}
+
+/* Print the current configuration of the PDA */
+static void trace(const struct compiled_grammar *cg, const char *word,
+		  size_t len, const struct stack *stack)
+{
+	int i;
+
+	printf("Word: ");
+	fwrite(word, 1, len, stdout);
+	printf("\t\t Stack: ");
+	/* The uppermost (last element in the array) must come first.  So read
+	 * the array in reverse order.
+	 */
+	for (i = stack->top - 1; i >= 0; i--)
+		print_symbol(stdout, cg, stack->content[i]);
+	printf("\n");
+}
+
+#ifndef PDA_LIBRARY
+/* Write the header of a binary trace: the magic, the version and the byte
+ * order, followed by the productions of the engine, one per line.  Records
+ * name productions by their line, so the trace can be decoded without the
+ * grammar.
+ */
+static bool write_trace_header(FILE *file, const struct compiled_grammar *cg)
+{
+	const unsigned int probe = 1;
+	unsigned int i;
+
+	fprintf(file, "%s %u %s %zu %u\n", TRACE_MAGIC, TRACE_VERSION,
+		*(const unsigned char *)&probe ? "little" : "big",
+		sizeof(struct trace_record), cg->num_productions);
+	for (i = 0; i < cg->num_productions; i++) {
+		print_production(file, cg, &cg->productions[i]);
+		fputc('\n', file);
+	}
+
+	return !ferror(file);
+}
+#endif
+
+static void trace_flush(const struct pda *pda, struct scratch *scratch)
+{
+	if (fwrite(scratch->trace_records, sizeof(*scratch->trace_records),
+		   scratch->trace_count, pda->trace_file) !=
+	    scratch->trace_count) {
+		perror("fwrite");
+		exit(EXIT_FAILURE);
+	}
+	scratch->trace_count = 0;
+}
+
+/* Append a record to the binary trace */
+static void trace_record(const struct pda *pda, struct scratch *scratch,
+			 unsigned long long step, size_t pos,
+			 unsigned int depth, int event)
+{
+	struct trace_record *record;
+
+	if (scratch->trace_count == TRACE_BUFFER_RECORDS)
+		trace_flush(pda, scratch);
+
+	record = &scratch->trace_records[scratch->trace_count++];
+	record->step = step;
+	record->pos = pos;
+	record->depth = depth;
+	record->event = event;
+}
+
+/* Make sure that the stack can hold top + len symbols.  Returns false if
+ * that would exceed max_depth, even if the buffer has room for them, so the
+ * depth is exact also while the stack lives in its inline buffer.
+ */
+static bool stack_reserve(struct stack *stack, unsigned int len,
+			  unsigned int max_depth)
+{
+	unsigned int needed = stack->top + len, size;
+	symbol_t *content;
+
+	if (needed > max_depth || needed < len)
+		return false;
+	if (needed <= stack->size)
+		return true;
+
+	size = stack->size;
+	while (size < needed)
+		size = size > UINT_MAX / 2 ? UINT_MAX : size * 2;
+
+	/* Like realloc(), keep the symbols above top, too.  next_production()
+	 * lowers top before it tries a production, and puts the nonterminal
+	 * back if none applies.
+	 */
+	if (stack->content == stack->inline_content) {
+		content = malloc((size_t)size * sizeof(*content));
+		if (content)
+			memcpy(content, stack->content,
+			       stack->size * sizeof(*content));
+	} else {
+		content = realloc(stack->content,
+				  (size_t)size * sizeof(*content));
+	}
+	if (!content) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+
+	stack->content = content;
+	stack->size = size;
+	return true;
+}
+
+static void stack_init(struct stack *stack)
+{
+	stack->content = stack->inline_content;
+	stack->size = STACK_INLINE_SIZE;
+	stack->top = 0;
+}
+
+static void stack_free(struct stack *stack)
+{
+	if (stack->content != stack->inline_content)
+		free(stack->content);
+	stack_init(stack);
+}
+
+static struct frame *push_frame(struct frames *frames)
+{
+	if (frames->count == frames->size) {
+		frames->size = frames->size ? frames->size * 2 : 1024;
+		frames->frame = realloc(frames->frame,
+					frames->size * sizeof(*frames->frame));
+		if (!frames->frame) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return &frames->frame[frames->count++];
+}
+
+/* Restore the configuration that the PDA had when it created frame.  The
+ * terminals that a terminal frame popped are exactly the chars of the input
+ * that they matched.
+ */
+static void restore_frame(const struct frame *frame, const char *word,
+			  struct stack *stack)
+{
+	unsigned int i;
+
+	stack->top = frame->top;
+	stack->yield = frame->yield;
+	if (frame->production != FRAME_TERMINAL) {
+		stack->content[frame->top - 1] = frame->symbol;
+		return;
+	}
+
+	for (i = 0; i < frame->len; i++)
+		stack->content[frame->top - 1 - i] =
+			(unsigned char)word[frame->pos + i];
+}
+
+/* Returns the index of the latest frame at position pos of the input whose
+ * top is not above top, or FRAME_NONE.  The frames at the same position are
+ * the latest ones, as every terminal frame moves the read head.  Frames above
+ * top are skipped along their below links, so we only visit frames of height
+ * top, which are few, see repeats().
+ */
+static unsigned int frame_below(const struct frames *frames, size_t pos,
+				unsigned int top)
+{
+	const struct frame *frame;
+	unsigned int i = frames->count ? frames->count - 1 : FRAME_NONE;
+
+	while (i != FRAME_NONE) {
+		frame = &frames->frame[i];
+		if (frame->pos != pos || frame->production == FRAME_TERMINAL)
+			return FRAME_NONE;
+		if (frame->top <= top)
+			return i;
+		i = frame->below;
+	}
+
+	return FRAME_NONE;
+}
+
+/* Returns true if the PDA went in a circle: the nonterminal symbol is on top
+ * of a stack of height top, and so it was for a frame of the current path, at
+ * the same position, with the same stack below.  below is what frame_below()
+ * returned for the configuration.  The stack below the nonterminal stayed
+ * the same as long as none of the frames in between popped below it, so we
+ * follow the below links as long as they stay at the same height.  Each of
+ * these frames replaced the nonterminal of the previous one by a production
+ * that ends in it, so there are no more of them than nonterminals.  Going
+ * around again would only lead back here, so the PDA may just as well
+ * backtrack.
+ */
+static bool repeats(const struct frames *frames, unsigned int below,
+		    unsigned int top, symbol_t symbol)
+{
+	const struct frame *frame;
+
+	while (below != FRAME_NONE) {
+		frame = &frames->frame[below];
+		if (frame->top != top)
+			return false;
+		if (frame->symbol == symbol)
+			return true;
+		below = frame->below;
+	}
+
+	return false;
+}
+
+/* Replace the nonterminal of frame by its next applicable production.  Returns
+ * false if there's no production left.  The stack must hold the configuration
+ * of the frame, and word is the rest of the input at the frame's position.
+ * The leading terminals of the production are matched right away, they never
+ * make it onto the stack.  So the read head moves ahead by the production's
+ * prefix.  If a production is skipped because it doesn't fit on the stack,
+ * limited is set.
+ */
+static bool next_production(const struct pda *pda, struct scratch *scratch,
+			    struct frame *frame, const char *word,
+			    size_t word_len, bool *limited)
+{
+	const struct compiled_grammar *cg = pda->g;
+	struct stack *stack = &scratch->stack;
+	const struct nonterminal *nterm = nonterminal(cg, frame->symbol);
+	const int end = nterm->first + nterm->count;
+	const unsigned int top = frame->top - 1;
+	const unsigned int yield = frame->yield - nterm->min_yield;
+	const unsigned char lookahead = word_len ? word[0] : END_OF_INPUT;
+	const struct production *p;
+
+	/* Iterate over each remaining production rule for the nonterminal */
+	while (++frame->production < end) {
+		p = &cg->productions[frame->production];
+
+		/* A rule that derives at least one terminal can only apply if
+		 * its derivations may start with the next char.  Rules that
+		 * derive the empty word leave the next char to what follows
+		 * the nonterminal, so they can't be filtered here.
+		 */
+		if (p->yield && !charset_has(&p->first_set, lookahead)) {
+			count_stat(pda, scratch, pruned, 1);
+			continue;
+		}
+
+		/* If the rule doesn't fit on our stack, skip it */
+		stack->top = top;
+		if (!stack_reserve(stack, p->len - p->prefix, scratch->depth)) {
+			*limited = true;
+			continue;
+		}
+
+		/* Replacing the nonterminal by the rule changes the minimal
+		 * yield of the stack.  If the stack can't produce a word that
+		 * is short enough for the rest of our input, there's no need
+		 * to try this rule.
+		 */
+		stack->yield = add_yield(yield, p->yield);
+		if (stack->yield > word_len) {
+			count_stat(pda, scratch, pruned, 1);
+			continue;
+		}
+
+		/* The yield of the rule includes its leading terminals, so
+		 * the input is long enough to compare them.
+		 */
+		if (memcmp(word, cg->prefix_chars + p->prefix_offset,
+			   p->prefix)) {
+			count_stat(pda, scratch, mismatches, 1);
+			continue;
+		}
+		stack->yield -= p->prefix;
+		count_stat(pda, scratch, matches, p->prefix);
+		count_stat(pda, scratch, expansions[frame->production], 1);
+
+		/* Copy the (reversed) rest of the rule over to our stack.
+		 * This makes the first element of the rest the uppermost.  The
+		 * nonterminal is gone, and our stack just grew by the length of
+		 * the rest.
+		 */
+		memcpy(stack->content + top, cg->symbols + p->offset,
+		       (p->len - p->prefix) * sizeof(*stack->content));
+		stack->top = top + p->len - p->prefix;
+		if (stack->top > stack->peak)
+			stack->peak = stack->top;
+		if (pda->memoize)
+			memo_forget(&scratch->memo, top);
+		return true;
+	}
+
+	/* Leave the nonterminal on the stack */
+	stack->top = frame->top;
+	return false;
+}
+
+/* Runs the predictive LL(1) parser on word.  For every nonterminal on top of
+ * the stack, the next char of the input determines the only production that
+ * can possibly apply.  So there's no backtracking, and the run takes linear
+ * time.
+ */
+static enum verdict run_ll1(const struct pda *pda, struct scratch *scratch,
+			    const char *word, size_t word_len)
+{
+	const struct compiled_grammar *cg = &pda->ll1->g;
+	struct stack *stack = &scratch->stack;
+	const struct production *p;
+	unsigned char lookahead;
+	struct frame *frame;
+	size_t pos = 0;
+	symbol_t top_stack;
+	int entry;
+
+	/* If we have to tell the derivation of the word, every applied
+	 * production gets a frame, just like in run_pda().
+	 */
+	scratch->frames.count = 0;
+
+	while (stack->top) {
+		if (PDA_TRACE && pda->trace)
+			trace(cg, word + pos, word_len - pos, stack);
+
+		top_stack = stack->content[--stack->top]; // POP
+		lookahead = pos < word_len ? word[pos] : END_OF_INPUT;
+
+		if (is_nonterminal(top_stack)) {
+			entry = pda->ll1->table[NONTERM_INDEX(top_stack)]
+					       [lookahead];
+			if (entry < 0)
+				return VERDICT_NAY;
+
+			p = &cg->productions[entry];
+			if (!stack_reserve(stack, p->len, pda->max_depth))
+				return VERDICT_LIMIT;
+			if (PDA_TRACE && pda->trace_file)
+				trace_record(pda, scratch, ++scratch->steps,
+					     pos, stack->top + 1, entry);
+
+			if (pda->derivation) {
+				frame = push_frame(&scratch->frames);
+				frame->symbol = top_stack;
+				frame->production = entry;
+			}
+
+			memcpy(stack->content + stack->top,
+			       cg->symbols + p->offset,
+			       p->len * sizeof(*stack->content));
+			stack->top += p->len;
+			if (stack->top > stack->peak)
+				stack->peak = stack->top;
+			continue;
+		}
+
+		/* Terminals must match the input */
+		if (pos == word_len || (unsigned char)word[pos] != top_stack)
+			return VERDICT_NAY;
+		if (PDA_TRACE && pda->trace_file)
+			trace_record(pda, scratch, ++scratch->steps, pos,
+				     stack->top + 1, TRACE_MATCH);
+		pos++;
+	}
+
+	if (PDA_TRACE && pda->trace)
+		trace(cg, word + pos, word_len - pos, stack);
+
+	return pos == word_len ? VERDICT_YEP : VERDICT_NAY;
+}
+
+/* Runs the deterministic PDA of the SLR(1) tables on word.  Every char is
+ * shifted once, and as the grammar has no conflicts, the reductions between
+ * two shifts can't loop either, so the run takes linear time.  The stack only
+ * holds the states.
+ */
+static enum verdict run_lr(const struct pda *pda, struct scratch *scratch,
+			   const char *word, size_t word_len)
+{
+	const struct lr *lr = pda->lr;
+	const struct lr_reduction *r;
+	unsigned int *states, top = 1, i;
+	unsigned char lookahead;
+	size_t pos = 0;
+	int action;
+
+	if (!scratch->lr_size) {
+		scratch->lr_size = STACK_INLINE_SIZE;
+		scratch->lr_states = malloc(scratch->lr_size *
+					    sizeof(*scratch->lr_states));
+		if (!scratch->lr_states) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	states = scratch->lr_states;
+	states[0] = 0;
+
+	for (;;) {
+		if (PDA_TRACE && pda->trace) {
+			printf("Word: ");
+			fwrite(word + pos, 1, word_len - pos, stdout);
+			printf("\t\t States:");
+			for (i = top; i > 0; i--)
+				printf(" %u", states[i - 1]);
+			printf("\n");
+		}
+
+		lookahead = pos < word_len ? word[pos] : END_OF_INPUT;
+		action = lr->action[states[top - 1]][lookahead];
+		if (action == LR_ERROR)
+			return VERDICT_NAY;
+		if (action == LR_ACCEPT)
+			return pos == word_len ? VERDICT_YEP : VERDICT_NAY;
+		if (PDA_TRACE && pda->trace_file)
+			trace_record(pda, scratch, ++scratch->steps, pos, top,
+				     action > 0 ? TRACE_MATCH : -action - 2);
+
+		/* Both shifting and reducing push a state, but only a shift
+		 * and a reduction of an empty right side grow the stack.  The
+		 * buffer may well be larger than the maximal depth, so the
+		 * depth is checked on its own.
+		 */
+		if (top >= pda->max_depth &&
+		    (action > 0 || !lr->reduction[-action - 2].len))
+			return VERDICT_LIMIT;
+		if (top == scratch->lr_size) {
+			scratch->lr_size = top > pda->max_depth / 2 ?
+					   pda->max_depth : top * 2;
+			states = realloc(states, scratch->lr_size *
+					 sizeof(*states));
+			if (!states) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+			scratch->lr_states = states;
+		}
+
+		if (action > 0) {
+			states[top++] = action - 1;
+			pos++;
+		} else {
+			r = &lr->reduction[-action - 2];
+			top -= r->len;
+			states[top] = lr->goto_state[(size_t)states[top - 1] *
+						     lr->num_nonterms +
+						     r->nonterm];
+			top++;
+		}
+		if (top > scratch->stack.peak)
+			scratch->stack.peak = top;
+	}
+}
+
+static unsigned int earley_hash(const struct earley_item *item)
+{
+	return (item->production * 31 + item->dot) * 16777619U ^
+	       item->origin * 2654435761U;
+}
+
+/* The hash table only holds items of the current set, which starts at item
+ * index from.  Slots that refer to an item of an earlier set are free.  So
+ * starting a new set doesn't require to clear the table.
+ */
+static bool earley_slot_free(const struct earley *e, unsigned int from,
+			     unsigned int slot)
+{
+	return e->hash[slot] <= from;
+}
+
+static void earley_rehash(struct earley *e, unsigned int from)
+{
+	unsigned int i, slot;
+
+	free(e->hash);
+	e->hash = calloc(e->hash_size, sizeof(*e->hash));
+	if (!e->hash) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = from; i < e->count; i++) {
+		slot = earley_hash(&e->items[i]) & (e->hash_size - 1);
+		while (e->hash[slot])
+			slot = (slot + 1) & (e->hash_size - 1);
+		e->hash[slot] = i + 1;
+	}
+}
+
+/* Add item to the current set, which starts at item index from, unless the set
+ * already contains it.
+ */
+static void earley_add(struct earley *e, unsigned int from,
+		       unsigned int production, unsigned int dot,
+		       unsigned int origin)
+{
+	const struct earley_item item = {
+		.production = production,
+		.dot = dot,
+		.origin = origin,
+	};
+	const struct earley_item *other;
+	unsigned int slot;
+
+	for (slot = earley_hash(&item) & (e->hash_size - 1);
+	     !earley_slot_free(e, from, slot);
+	     slot = (slot + 1) & (e->hash_size - 1)) {
+		other = &e->items[e->hash[slot] - 1];
+		if (other->production == production && other->dot == dot &&
+		    other->origin == origin)
+			return;
+	}
+
+	if (e->count == e->size) {
+		e->size = e->size ? e->size * 2 : 1024;
+		e->items = realloc(e->items, e->size * sizeof(*e->items));
+		if (!e->items) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	e->items[e->count++] = item;
+	e->hash[slot] = e->count;
+
+	/* Keep the load factor of the hash table below 1/2 */
+	if (2 * (e->count - from) > e->hash_size) {
+		e->hash_size *= 2;
+		earley_rehash(e, from);
+	}
+}
+
+static void earley_scan(struct earley *e, unsigned int production,
+			unsigned int dot, unsigned int origin)
+{
+	if (e->next_count == e->next_size) {
+		e->next_size = e->next_size ? e->next_size * 2 : 64;
+		e->next = realloc(e->next, e->next_size * sizeof(*e->next));
+		if (!e->next) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	e->next[e->next_count].production = production;
+	e->next[e->next_count].dot = dot;
+	e->next[e->next_count].origin = origin;
+	e->next_count++;
+}
+
+static struct leo_entry *leo_slot(struct earley *e, unsigned int set,
+				  symbol_t symbol)
+{
+	struct leo_entry *entry;
+	unsigned int i;
+
+	for (i = (set * 2654435761U ^ symbol) & (e->leo_size - 1); ;
+	     i = (i + 1) & (e->leo_size - 1)) {
+		entry = &e->leo[i];
+		if (!entry->symbol ||
+		    (entry->set == set && entry->symbol == symbol))
+			return entry;
+	}
+}
+
+static void leo_insert(struct earley *e, const struct leo_entry *new)
+{
+	struct leo_entry *old = e->leo;
+	unsigned int i, old_size = e->leo_size;
+
+	if (2 * (e->leo_used + 1) > e->leo_size) {
+		e->leo_size = old_size ? old_size * 2 : 256;
+		e->leo = calloc(e->leo_size, sizeof(*e->leo));
+		if (!e->leo) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < old_size; i++)
+			if (old[i].symbol)
+				*leo_slot(e, old[i].set, old[i].symbol) =
+					old[i];
+		free(old);
+	}
+
+	*leo_slot(e, new->set, new->symbol) = *new;
+	e->leo_used++;
+}
+
+/* Forget the topmost items of all sets from set on */
+static void leo_forget(struct earley *e, unsigned int set)
+{
+	struct leo_entry *old = e->leo;
+	unsigned int i;
+
+	if (!e->leo_used)
+		return;
+
+	e->leo = calloc(e->leo_size, sizeof(*e->leo));
+	if (!e->leo) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	e->leo_used = 0;
+	for (i = 0; i < e->leo_size; i++) {
+		if (!old[i].symbol || old[i].set >= set)
+			continue;
+		*leo_slot(e, old[i].set, old[i].symbol) = old[i];
+		e->leo_used++;
+	}
+	free(old);
+}
+
+/* Leo's optimization.  Right recursive rules like A -> aA make an Earley
+ * parser quadratic: a completed A at the end of the word completes the A of
+ * every previous position, one after another.  If the set where symbol started
+ * contains exactly one item that waits for symbol, and symbol is the last
+ * symbol of this item, then completing symbol completes exactly this item,
+ * and nothing else.  Following such items down to the first one that doesn't
+ * qualify gives the topmost item of a deterministic reduction path.  It
+ * suffices to add the topmost item directly, the items in between have no
+ * other use.  We never skip a completed start symbol that started at the
+ * beginning of the word, as that's what we accept the word on.
+ *
+ * The topmost items are memoized per set and symbol.  Returns false if there
+ * is no deterministic reduction path for symbol in set.
+ */
+static bool earley_leo(struct earley *e, const struct compiled_grammar *cg,
+		       symbol_t start, unsigned int set, symbol_t symbol,
+		       struct leo_entry *top)
+{
+	const struct earley_item *item, *waiting;
+	const struct production *p;
+	struct leo_entry *entry;
+	unsigned int i, count = 0;
+	int n;
+
+	for (;;) {
+		if (e->leo_size) {
+			entry = leo_slot(e, set, symbol);
+			if (entry->symbol) {
+				*top = *entry;
+				break;
+			}
+		}
+
+		/* Search for the only item of set that waits for symbol */
+		waiting = NULL;
+		for (i = e->set[set]; i < e->set[set + 1]; i++) {
+			item = &e->items[i];
+			p = &cg->productions[item->production];
+			if (item->dot < p->len &&
+			    production_symbol(cg, p, item->dot) == symbol) {
+				if (waiting) {
+					waiting = NULL;
+					break;
+				}
+				waiting = item;
+			}
+		}
+
+		if (!waiting || waiting->dot !=
+		    cg->productions[waiting->production].len - 1) {
+			top->set = set;
+			top->symbol = symbol;
+			top->production = -1;
+			leo_insert(e, top);
+			break;
+		}
+
+		if (count == e->path_size) {
+			e->path_size = e->path_size ? e->path_size * 2 : 64;
+			e->path = realloc(e->path,
+					  e->path_size * sizeof(*e->path));
+			if (!e->path) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		e->path[count].set = set;
+		e->path[count].symbol = symbol;
+		e->path[count].production = waiting->production;
+		e->path[count].origin = waiting->origin;
+		count++;
+
+		symbol = cg->productions[waiting->production].lhs;
+		set = waiting->origin;
+		if (symbol == start && set == 0) {
+			top->production = -1;
+			break;
+		}
+	}
+
+	/* Resolve the path from the top: if the item further down has no
+	 * path, the completed item of this step is the topmost one.
+	 */
+	for (n = count - 1; n >= 0; n--) {
+		if (top->production < 0) {
+			top->production = e->path[n].production;
+			top->origin = e->path[n].origin;
+		}
+		top->set = e->path[n].set;
+		top->symbol = e->path[n].symbol;
+		leo_insert(e, top);
+	}
+
+	return top->production >= 0;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Check the budget of the current word, which is due whenever steps reaches
+ * next_check.  Returns true if the word used it up.
+ */
+static bool out_of_budget(const struct pda *pda, struct scratch *scratch)
+{
+	if (pda->max_steps && scratch->steps > pda->max_steps)
+		return true;
+	if (pda->timeout && now_ns() >= scratch->deadline)
+		return true;
+
+	/* A searcher also gives up if the others came to a verdict */
+	if (scratch->searcher && atomic_load(&scratch->searcher->search->done))
+		return true;
+
+	scratch->next_check = pda->timeout || scratch->searcher ?
+			      scratch->steps + BUDGET_CLOCK_STEPS : ULLONG_MAX;
+	if (pda->max_steps && scratch->next_check > pda->max_steps)
+		scratch->next_check = pda->max_steps + 1;
+	return false;
+}
+
+/* Runs an Earley recognizer on word.  Set i of the chart holds all items that
+ * are consistent with the first i chars of the word.  Each item of a set is
+ * processed exactly once:
+ *  - predict: if the dot is in front of a nonterminal, add all of its
+ *    productions with the dot at the beginning.  If the nonterminal is
+ *    nullable, also move the dot over it.
+ *  - scan: if the dot is in front of the next char of the word, move the dot
+ *    over it in the next set.
+ *  - complete: if the dot is at the end, move the dot over the nonterminal in
+ *    all items of the origin set that wait for it.
+ * The word is accepted if the last set holds a completed production of the
+ * start symbol that started at the beginning.
+ *
+ * As the chart never contains an item twice, this terminates for every
+ * grammar, including left recursive ones.  It takes cubic time in the worst
+ * case.  With Leo's optimization, it takes linear time for LR(k) grammars,
+ * even if they are right recursive.
+ *
+ * Set i only depends on the first i chars of the word.  If the first
+ * unchanged chars of word are those of the word of the last run, the sets up
+ * to there are still in the chart, and we pick up from the last of them.
+ */
+static enum verdict run_earley(const struct pda *pda,
+			       struct scratch *scratch, const char *word,
+			       size_t len, size_t unchanged)
+{
+	const struct compiled_grammar *cg = pda->g;
+	const unsigned int word_len = len;
+	struct earley *e = &scratch->earley;
+	const struct production *p, *q;
+	const struct nonterminal *nterm = nonterminal(cg, pda->start);
+	const symbol_t start = pda->start;
+	unsigned int pos, i, j, end;
+	struct leo_entry top;
+	enum verdict ret = VERDICT_NAY;
+	unsigned int resume;
+	symbol_t symbol;
+
+	/* Items store positions as unsigned int, which is plenty for any
+	 * word whose chart fits into memory.
+	 */
+	if (len >= UINT_MAX - 1) {
+		e->complete = 0;
+		return VERDICT_LIMIT;
+	}
+	resume = unchanged < e->complete ? unchanged : e->complete;
+
+	/* Start from an empty chart, or from the last set that is still
+	 * valid, but keep the memory of the last run.
+	 */
+	e->next_count = 0;
+	if (!resume) {
+		e->count = 0;
+		if (e->leo_used)
+			memset(e->leo, 0, e->leo_size * sizeof(*e->leo));
+		e->leo_used = 0;
+	} else {
+		e->count = e->set[resume];
+		leo_forget(e, resume);
+	}
+	if (!e->hash_size) {
+		e->hash_size = 64;
+		earley_rehash(e, 0);
+	} else {
+		memset(e->hash, 0, e->hash_size * sizeof(*e->hash));
+	}
+	if (word_len + 2 > e->set_size) {
+		e->set_size = word_len + 2;
+		e->set = realloc(e->set, e->set_size * sizeof(*e->set));
+		if (!e->set) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* The char in front of set resume may have changed, so scan the
+	 * set before it again.
+	 */
+	if (resume) {
+		for (i = e->set[resume - 1]; i < e->set[resume]; i++) {
+			p = &cg->productions[e->items[i].production];
+			if (e->items[i].dot < p->len &&
+			    production_symbol(cg, p, e->items[i].dot) ==
+			    (unsigned char)word[resume - 1])
+				earley_scan(e, e->items[i].production,
+					    e->items[i].dot + 1,
+					    e->items[i].origin);
+		}
+	}
+	e->complete = resume;
+
+	for (pos = resume; pos <= word_len; pos++) {
+		e->set[pos] = e->count;
+
+		if (pos == 0) {
+			for (i = 0; i < nterm->count; i++)
+				earley_add(e, 0, nterm->first + i, 0, 0);
+		} else {
+			for (i = 0; i < e->next_count; i++)
+				earley_add(e, e->set[pos], e->next[i].production,
+					   e->next[i].dot, e->next[i].origin);
+		}
+		e->next_count = 0;
+
+		/* The set grows while we process it.  As earley_add() might
+		 * move the items, work on a copy of the current one.
+		 */
+		for (i = e->set[pos]; i < e->count; i++) {
+			const struct earley_item item = e->items[i];
+
+			p = &cg->productions[item.production];
+			if (item.dot < p->len) {
+				symbol = production_symbol(cg, p, item.dot);
+
+				if (!is_nonterminal(symbol)) {
+					if (pos < word_len &&
+					    (unsigned char)word[pos] == symbol)
+						earley_scan(e, item.production,
+							    item.dot + 1,
+							    item.origin);
+					continue;
+				}
+
+				if (nullable(cg, symbol))
+					earley_add(e, e->set[pos],
+						   item.production,
+						   item.dot + 1, item.origin);
+				nterm = nonterminal(cg, symbol);
+				for (j = 0; j < nterm->count; j++)
+					earley_add(e, e->set[pos],
+						   nterm->first + j, 0, pos);
+				continue;
+			}
+
+			/* Completion.  Items of the origin set that wait for
+			 * our nonterminal move on.  If the origin is the
+			 * current set, the nullable case of the prediction
+			 * above already took care of it.
+			 */
+			if (item.origin == pos)
+				continue;
+			if (earley_leo(e, cg, start, item.origin, p->lhs,
+				       &top)) {
+				earley_add(e, e->set[pos], top.production,
+					   cg->productions[top.production].len,
+					   top.origin);
+				continue;
+			}
+			end = e->set[item.origin + 1];
+			for (j = e->set[item.origin]; j < end; j++) {
+				const struct earley_item waiting = e->items[j];
+
+				q = &cg->productions[waiting.production];
+				if (waiting.dot < q->len &&
+				    production_symbol(cg, q, waiting.dot) ==
+				    p->lhs)
+					earley_add(e, e->set[pos],
+						   waiting.production,
+						   waiting.dot + 1,
+						   waiting.origin);
+			}
+		}
+
+		e->set[pos + 1] = e->count;
+		e->complete = pos + 1;
+
+		/* Each item is a step of the budget.  The last set is as
+		 * good as the verdict, so it is never cut short.
+		 */
+		scratch->steps += e->count - e->set[pos];
+		if (pos < word_len && scratch->steps >= scratch->next_check &&
+		    out_of_budget(pda, scratch)) {
+			ret = VERDICT_UNDECIDED;
+			goto out;
+		}
+
+		if (PDA_TRACE && pda->trace) {
+			printf("Word: ");
+			fwrite(word + pos, 1, word_len - pos, stdout);
+			printf("\t\t Items: %u\n", e->count - e->set[pos]);
+		}
+
+		/* No item survived the scan, the word can't be accepted */
+		if (pos < word_len && !e->next_count)
+			goto out;
+	}
+
+	for (i = e->set[word_len]; i < e->count; i++) {
+		p = &cg->productions[e->items[i].production];
+		if (p->lhs == start && e->items[i].dot == p->len &&
+		    e->items[i].origin == 0) {
+			ret = VERDICT_YEP;
+			break;
+		}
+	}
+
+out:
+	return ret;
+}
+
+static void earley_free(struct earley *e)
+{
+	free(e->items);
+	free(e->set);
+	free(e->next);
+	free(e->hash);
+	free(e->leo);
+	free(e->path);
+}
+
+/* Returns the cell of the CYK table for the span of len chars at pos.  The
+ * table stores the spans by length: all n spans of length 1 first, then the
+ * n - 1 spans of length 2, and so on.
+ */
+static unsigned long *cyk_cell(const struct cyk *cyk, unsigned long *table,
+			       size_t n, size_t len, size_t pos)
+{
+	size_t row = (len - 1) * (n + 1) - (len - 1) * len / 2;
+
+	return &table[(row + pos) * cyk->set_words];
+}
+
+/* dst |= the set of all A with A -> BC, B in left and C in right.  For every
+ * B in left, a single AND tells whether any of its partners C is in right at
+ * all.  If so, the heads of the pairs that match are ORed into dst, one word
+ * at a time.
+ */
+static void cyk_combine(const struct cyk *cyk, unsigned long *dst,
+			const unsigned long *left, const unsigned long *right)
+{
+	const unsigned int words = cyk->set_words;
+	const unsigned long *rights, *heads;
+	unsigned int w, x, b, pair;
+	unsigned long bits, any;
+
+	for (w = 0; w < words; w++) {
+		for (bits = left[w]; bits; bits &= bits - 1) {
+			b = w * CHARSET_WORD_BITS + __builtin_ctzl(bits);
+			rights = &cyk->rights[b * words];
+
+			for (any = 0, x = 0; x < words; x++)
+				any |= rights[x] & right[x];
+			if (!any)
+				continue;
+
+			for (pair = cyk->first_pair[b];
+			     pair < cyk->first_pair[b + 1]; pair++) {
+				if (!bitset_has(right, cyk->pair_right[pair]))
+					continue;
+				heads = &cyk->pair_heads[pair * words];
+				for (x = 0; x < words; x++)
+					dst[x] |= heads[x];
+			}
+		}
+	}
+}
+
+/* The Cocke-Younger-Kasami recognizer.  Cell (len, pos) of the table is the
+ * set of nonterminals of the CNF grammar that derive the span of len chars
+ * at pos.  Spans of one char are looked up, longer ones are combined from
+ * every split into two shorter ones.  This takes cubic time no matter in
+ * which order the productions come, and quadratic memory, which is why we
+ * give up on words whose table wouldn't fit into CYK_MAX_TABLE bytes.
+ */
+static enum verdict run_cyk(const struct pda *pda, struct scratch *scratch,
+			    const char *word, size_t n)
+{
+	const struct cyk *cyk = pda->cyk;
+	const size_t words = cyk->set_words;
+	unsigned long *table, *dst;
+	size_t len, pos, split, cells, x;
+	unsigned int nonempty;
+
+	if (!n)
+		return cyk->empty ? VERDICT_YEP : VERDICT_NAY;
+
+	if (n > CYK_MAX_TABLE / sizeof(unsigned long) / words / (n + 1) * 2)
+		return VERDICT_LIMIT;
+	cells = n * (n + 1) / 2 * words;
+	if (cells > scratch->cyk_size) {
+		free(scratch->cyk_table);
+		scratch->cyk_table = malloc(cells * sizeof(unsigned long));
+		if (!scratch->cyk_table) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		scratch->cyk_size = cells;
+	}
+	table = scratch->cyk_table;
+
+	for (pos = 0; pos < n; pos++) {
+		memcpy(cyk_cell(cyk, table, n, 1, pos),
+		       &cyk->terminal[(unsigned char)word[pos] * words],
+		       words * sizeof(unsigned long));
+	}
+
+	for (len = 2; len <= n; len++) {
+		nonempty = 0;
+		for (pos = 0; pos + len <= n; pos++) {
+			dst = cyk_cell(cyk, table, n, len, pos);
+			memset(dst, 0, words * sizeof(unsigned long));
+			for (split = 1; split < len; split++)
+				cyk_combine(cyk, dst,
+					    cyk_cell(cyk, table, n, split, pos),
+					    cyk_cell(cyk, table, n, len - split,
+						     pos + split));
+
+			for (x = 0; x < words && !dst[x]; x++);
+			nonempty += x < words;
+		}
+
+		/* Each split of a span is a step of the budget */
+		scratch->steps += (n - len + 1) * (len - 1);
+		if (len < n && scratch->steps >= scratch->next_check &&
+		    out_of_budget(pda, scratch))
+			return VERDICT_UNDECIDED;
+
+		if (PDA_TRACE && pda->trace)
+			printf("Length: %zu\t\t Cells: %u\n", len, nonempty);
+	}
+
+	return bitset_has(cyk_cell(cyk, table, n, n, 0),
+			  NONTERM_INDEX(cyk->start)) ? VERDICT_YEP : VERDICT_NAY;
+}
+
+/* Take a snapshot of the configuration of the PDA */
+static void snapshot(struct task *task, size_t pos, const struct stack *stack,
+		     unsigned int level)
+{
+	task->pos = pos;
+	task->top = stack->top;
+	task->yield = stack->yield;
+	task->level = level;
+	task->content = malloc((stack->top + 1) * sizeof(*task->content));
+	if (!task->content) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(task->content, stack->content,
+	       stack->top * sizeof(*task->content));
+}
+
+/* Wake the idle searchers, because there are tasks, or the search is over */
+static void search_wake(struct search *search)
+{
+	pthread_mutex_lock(&search->lock);
+	pthread_cond_broadcast(&search->work);
+	pthread_mutex_unlock(&search->lock);
+}
+
+/* Queue n tasks at the tail of the deque of searcher, the last one first, so
+ * the first one is the next to be taken from the tail.  The tasks count as
+ * pending before anybody can take them.
+ */
+static void push_tasks(struct searcher *searcher, const struct task *task,
+		       unsigned int n)
+{
+	struct search *search = searcher->search;
+	unsigned int i;
+
+	atomic_fetch_add(&search->pending, n);
+	atomic_fetch_add(&search->queued, n);
+
+	pthread_mutex_lock(&searcher->lock);
+	if (searcher->count + n > searcher->size && searcher->head) {
+		memmove(searcher->task, searcher->task + searcher->head,
+			(searcher->count - searcher->head) *
+			sizeof(*searcher->task));
+		searcher->count -= searcher->head;
+		searcher->head = 0;
+	}
+	while (searcher->count + n > searcher->size) {
+		searcher->size = searcher->size ? searcher->size * 2 : 64;
+		searcher->task = realloc(searcher->task, searcher->size *
+					 sizeof(*searcher->task));
+		if (!searcher->task) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = n; i--;)
+		searcher->task[searcher->count++] = task[i];
+	pthread_mutex_unlock(&searcher->lock);
+
+	/* A searcher that becomes idle counts itself before it looks at
+	 * queued, so either it sees our tasks, or we see it
+	 */
+	if (atomic_load(&search->idle))
+		search_wake(search);
+}
+
+/* Take a task from the tail of our own deque, or else steal one from the head
+ * of another searcher's deque.  Returns false if there's none at all.
+ */
+static bool take_task(struct searcher *searcher, struct task *task)
+{
+	struct search *search = searcher->search;
+	struct searcher *victim;
+	unsigned int i;
+	bool found = false;
+
+	pthread_mutex_lock(&searcher->lock);
+	if (searcher->count > searcher->head) {
+		*task = searcher->task[--searcher->count];
+		found = true;
+	}
+	pthread_mutex_unlock(&searcher->lock);
+
+	for (i = 1; i < search->count && !found; i++) {
+		victim = &search->searcher[(searcher - search->searcher + i) %
+					   search->count];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->count > victim->head) {
+			*task = victim->task[victim->head++];
+			found = true;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	if (found)
+		atomic_fetch_sub(&search->queued, 1);
+	return found;
+}
+
+/* If some searchers are idle and there's nothing left for them to take, hand
+ * the configuration of the PDA at word over to them.  Returns true if it was
+ * handed over, then the caller goes on as if the configuration had failed:
+ * if it succeeds, the search accepts the word anyway.
+ */
+static bool search_donate(struct scratch *scratch, const char *word,
+			  const struct stack *stack)
+{
+	struct search *search = scratch->searcher->search;
+	struct task task;
+
+	if (!atomic_load(&search->idle) || atomic_load(&search->queued))
+		return false;
+
+	snapshot(&task, word - search->word, stack, 0);
+	push_tasks(scratch->searcher, &task, 1);
+	return true;
+}
+
+/* Runs the PDA on word.  If memo is not NULL, failed configurations are
+ * remembered, and the PDA will never explore a configuration twice.
+ *
+ * Instead of recursing, the PDA keeps its own stack of frames on the heap.
+ * Every step that pops a symbol from the stack pushes a frame, which allows
+ * to undo the step when backtracking: the popped symbol is simply written
+ * back.  A frame of a nonterminal also remembers which production we're
+ * currently trying, so we can continue with the next one.  The depth of the
+ * search is only limited by the available memory.
+ *
+ * Every step counts against the budget of the word.  Once it's used up, the
+ * PDA gives up and leaves the word undecided, however close it might be.
+ * Whenever the budget is checked, a searcher of the parallel search may also
+ * hand its configuration over to idle searchers, see run_parallel().
+ */
+static enum verdict run_pda(const struct pda *pda, struct scratch *scratch,
+			    const char *word, size_t word_len)
+{
+	struct memo *memo = pda->memoize ? &scratch->memo : NULL;
+	struct frames *frames = &scratch->frames;
+	struct stack *stack = &scratch->stack;
+	struct frame *frame;
+	bool limited = false;
+	enum verdict ret;
+	unsigned int len, below;
+	size_t pos = 0;
+	symbol_t top_stack;
+
+	/* The stack may be a new one, see struct memo */
+	if (memo)
+		memo_forget(memo, 0);
+	scratch->memo_full = false;
+
+	frames->count = 0;
+	for (;;) {
+		if (++scratch->steps >= scratch->next_check) {
+			if (out_of_budget(pda, scratch)) {
+				ret = VERDICT_UNDECIDED;
+				break;
+			}
+			if (scratch->searcher && frames->count &&
+			    search_donate(scratch, word + pos, stack))
+				goto backtrack;
+		}
+
+		if (PDA_TRACE && pda->trace)
+			trace(pda->g, word + pos, word_len - pos, stack);
+
+		/* If our stack is empty, we still might have characters left
+		 * in our word.  If so, the run of our PDA was not successful
+		 * on this path.  Otherwise, it was successful.
+		 */
+		if (stack->top == 0) {
+			if (pos == word_len) {
+				ret = VERDICT_YEP;
+				break;
+			}
+			goto backtrack;
+		}
+
+		/* Peek at the uppermost element of our stack.
+		 * stack->top points to the next free slot, so the uppermost
+		 * element is right below.
+		 */
+		top_stack = stack->content[stack->top - 1];
+
+		/* Check if we have a nonterminal symbol on our stack */
+		if (is_nonterminal(top_stack)) {
+			/* Did we already try this configuration and fail?
+			 * Then there's no need to try it again.  Note that we
+			 * only memoize configurations with a nonterminal on
+			 * top of the stack, as only those have more than one
+			 * successor.
+			 */
+			if (memo && memo_known_failure(memo, word + pos,
+						       stack)) {
+				count_stat(pda, scratch, memo_hits, 1);
+				goto backtrack;
+			}
+
+			/* A circle isn't a failure of the configuration, its
+			 * first visit is still being explored.  So it must not
+			 * be memoized.
+			 */
+			below = FRAME_NONE;
+			if (pda->cyclic) {
+				below = frame_below(frames, pos, stack->top);
+				if (nonterminal(pda->g, top_stack)->cyclic &&
+				    repeats(frames, below, stack->top,
+					    top_stack))
+					goto backtrack;
+			}
+
+			frame = push_frame(frames);
+			if (PDA_STATS && pda->stats &&
+			    frames->count > scratch->stats.depth)
+				scratch->stats.depth = frames->count;
+			frame->pos = pos;
+			frame->top = stack->top;
+			frame->yield = stack->yield;
+			frame->symbol = top_stack;
+			frame->below = below;
+			frame->production =
+				nonterminal(pda->g, top_stack)->first - 1;
+
+			/* Replace the nonterminal by its first production */
+			if (next_production(pda, scratch, frame, word + pos,
+					    word_len - pos, &limited)) {
+				if (PDA_TRACE && pda->trace_file)
+					trace_record(pda, scratch,
+						     scratch->steps, pos,
+						     frame->top,
+						     frame->production);
+				pos += pda->g->productions[frame->production]
+					       .prefix;
+				continue;
+			}
+
+			/* No production applies at all */
+			frames->count--;
+			if (memo &&
+			    !memo_add_failure(memo, word + pos, stack)) {
+				scratch->memo_full = true;
+				ret = VERDICT_LIMIT;
+				break;
+			}
+			goto backtrack;
+		}
+
+		/* Here we land if we have a terminal char on our stack.
+		 *
+		 * Terminals don't leave any choice, so we match the whole run
+		 * of terminals on top of the stack at once.  Every terminal of
+		 * the run must be equal to the next char of our word.  If we
+		 * run out of chars, or a terminal doesn't match, the PDA does
+		 * not accept the word on this path.  Otherwise, consume the
+		 * run and the chars, and run the PDA on the rest-word and the
+		 * stack.
+		 */
+		for (len = 0; len < stack->top; len++) {
+			top_stack = stack->content[stack->top - 1 - len];
+			if (is_nonterminal(top_stack))
+				break;
+			if (pos + len == word_len ||
+			    (unsigned char)word[pos + len] != top_stack) {
+				count_stat(pda, scratch, mismatches, 1);
+				goto backtrack;
+			}
+		}
+		count_stat(pda, scratch, matches, len);
+		if (PDA_TRACE && pda->trace_file)
+			trace_record(pda, scratch, scratch->steps, pos,
+				     stack->top, TRACE_MATCH);
+
+		frame = push_frame(frames);
+		frame->pos = pos;
+		frame->top = stack->top;
+		frame->yield = stack->yield;
+		frame->production = FRAME_TERMINAL;
+		frame->len = len;
+
+		stack->top -= len; // POP
+		stack->yield -= len;
+		pos += len;
+		continue;
+
+backtrack:
+		/* Undo steps until we find a nonterminal that has a
+		 * production left.  If there's none, the PDA didn't recognize
+		 * the word in any path.
+		 */
+		count_stat(pda, scratch, backtracks, 1);
+		if (PDA_TRACE && pda->trace_file)
+			trace_record(pda, scratch, scratch->steps, pos,
+				     stack->top, TRACE_FAIL);
+		for (;;) {
+			if (frames->count == 0) {
+				ret = limited ? VERDICT_LIMIT : VERDICT_NAY;
+				goto out;
+			}
+
+			frame = &frames->frame[frames->count - 1];
+			restore_frame(frame, word, stack);
+			pos = frame->pos;
+			if (memo)
+				memo_forget(memo, frame->production ==
+						  FRAME_TERMINAL ?
+						  frame->top - frame->len :
+						  frame->top - 1);
+
+			if (frame->production != FRAME_TERMINAL) {
+				count_stat(pda, scratch,
+					   failures[frame->production], 1);
+				if (next_production(pda, scratch, frame,
+						    word + pos, word_len - pos,
+						    &limited)) {
+					if (PDA_TRACE && pda->trace_file)
+						trace_record(pda, scratch,
+							     scratch->steps,
+							     pos, frame->top,
+							     frame->production);
+					pos += pda->g->productions
+						[frame->production].prefix;
+					break;
+				}
+				if (memo &&
+				    !memo_add_failure(memo, word + pos,
+						      stack)) {
+					scratch->memo_full = true;
+					ret = VERDICT_LIMIT;
+					goto out;
+				}
+			}
+			frames->count--;
+		}
+	}
+
+out:
+	if (PDA_STATS && pda->stats && stack->peak > scratch->stats.height)
+		scratch->stats.height = stack->peak;
+
+	/* If the word was accepted, the frames hold the path that accepted
+	 * it.  Otherwise, all frames are gone anyway.
+	 */
+	return ret;
+}
+
+/* Only the parse trees of the command line tool live in the arena */
+#ifndef PDA_LIBRARY
+static void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block = arena->current;
+	size_t block_size;
+	void *ptr;
+
+	/* Keep everything aligned for pointers */
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (!block || block->used + size > block->size) {
+		/* Move on to the next block, if a previous tree left one
+		 * that is large enough.  Otherwise, insert a new one.
+		 */
+		if (block && block->next && block->next->size >= size) {
+			block = block->next;
+		} else {
+			block_size = size > ARENA_BLOCK_SIZE ? size :
+				     ARENA_BLOCK_SIZE;
+			block = malloc(sizeof(*block) + block_size);
+			if (!block) {
+				perror("malloc");
+				exit(EXIT_FAILURE);
+			}
+			block->size = block_size;
+			if (arena->current) {
+				block->next = arena->current->next;
+				arena->current->next = block;
+			} else {
+				block->next = arena->first;
+				arena->first = block;
+			}
+		}
+		block->used = 0;
+		arena->current = block;
+	}
+
+	ptr = (char *)block->data + block->used;
+	block->used += size;
+
+	return ptr;
+}
+
+/* Free everything that was allocated from the arena, but keep the blocks */
+static void arena_reset(struct arena *arena)
+{
+	arena->current = arena->first;
+	if (arena->current)
+		arena->current->used = 0;
+}
+#endif
+
+static void arena_free(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	for (block = arena->first; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	arena->first = arena->current = NULL;
+}
+
+static struct scratch *scratch_new(const struct pda *pda)
+{
+	struct scratch *scratch;
+	struct stats *stats;
+
+	/* struct scratch holds the inline stack, keep it off the call stack */
+	scratch = calloc(1, sizeof(*scratch));
+	if (!scratch) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	stack_init(&scratch->stack);
+
+	if (PDA_TRACE && pda->trace_file) {
+		scratch->trace_records = malloc(TRACE_BUFFER_RECORDS *
+						sizeof(*scratch->trace_records));
+		if (!scratch->trace_records) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (PDA_STATS && pda->stats) {
+		stats = &scratch->stats;
+		stats->num_productions = pda->g->num_productions;
+		stats->expansions = calloc(stats->num_productions + 1,
+					   sizeof(*stats->expansions));
+		stats->failures = calloc(stats->num_productions + 1,
+					 sizeof(*stats->failures));
+		if (!stats->expansions || !stats->failures) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return scratch;
+}
+
+static void scratch_free(struct scratch *scratch)
+{
+	struct searcher *searcher;
+	unsigned int i;
+
+	stack_free(&scratch->stack);
+	free(scratch->frames.frame);
+	memo_free(&scratch->memo);
+	earley_free(&scratch->earley);
+	free(scratch->cyk_table);
+	free(scratch->lr_states);
+	free(scratch->trace_records);
+	free(scratch->stats.expansions);
+	free(scratch->stats.failures);
+	arena_free(&scratch->arena);
+
+	/* The searchers of the parallel search, if there are any */
+	if (scratch->search) {
+		pthread_mutex_lock(&scratch->search->lock);
+		scratch->search->quit = true;
+		pthread_cond_broadcast(&scratch->search->wake);
+		pthread_mutex_unlock(&scratch->search->lock);
+	}
+	for (i = 0; scratch->search && i < scratch->search->count; i++) {
+		searcher = &scratch->search->searcher[i];
+		pthread_join(searcher->thread, NULL);
+		scratch_free(searcher->scratch);
+		pthread_mutex_destroy(&searcher->lock);
+		free(searcher->task);
+		free(searcher->children);
+	}
+	if (scratch->search) {
+		pthread_cond_destroy(&scratch->search->work);
+		pthread_cond_destroy(&scratch->search->finished);
+		pthread_cond_destroy(&scratch->search->wake);
+		pthread_mutex_destroy(&scratch->search->lock);
+		free(scratch->search->searcher);
+		free(scratch->search);
+	}
+
+	free(scratch);
+}
+
+/* Add everything that src counted to dst, both count for the same grammar */
+static void stats_add(struct stats *dst, const struct stats *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < dst->num_productions; i++) {
+		dst->expansions[i] += src->expansions[i];
+		dst->failures[i] += src->failures[i];
+	}
+
+	dst->matches += src->matches;
+	dst->mismatches += src->mismatches;
+	dst->pruned += src->pruned;
+	dst->backtracks += src->backtracks;
+	dst->memo_hits += src->memo_hits;
+	if (src->height > dst->height)
+		dst->height = src->height;
+	if (src->depth > dst->depth)
+		dst->depth = src->depth;
+}
+
+/* Forget everything that a searcher counted, once it's added to the total */
+static void stats_clear(struct stats *stats)
+{
+	memset(stats->expansions, 0,
+	       stats->num_productions * sizeof(*stats->expansions));
+	memset(stats->failures, 0,
+	       stats->num_productions * sizeof(*stats->failures));
+	stats->matches = stats->mismatches = stats->pruned = 0;
+	stats->backtracks = stats->memo_hits = 0;
+}
+
+/* Split the task that's on the stack of searcher.  The run of terminals on top
+ * of the stack is matched right away, and every production that applies to
+ * the nonterminal below becomes a task of its own.
+ */
+static enum verdict split_task(struct searcher *searcher,
+			       const struct task *task)
+{
+	struct search *search = searcher->search;
+	const struct pda *pda = search->pda;
+	struct scratch *scratch = searcher->scratch;
+	struct stack *stack = &scratch->stack;
+	const char *word = search->word;
+	size_t pos = task->pos;
+	bool limited = false;
+	struct frame frame;
+	unsigned int n = 0;
+	symbol_t top = 0;
+
+	while (stack->top) {
+		top = stack->content[stack->top - 1];
+		if (is_nonterminal(top))
+			break;
+		if (pos == search->len || (unsigned char)word[pos] != top)
+			return VERDICT_NAY;
+		stack->top--;
+		stack->yield--;
+		pos++;
+	}
+	if (!stack->top)
+		return pos == search->len ? VERDICT_YEP : VERDICT_NAY;
+
+	frame.pos = pos;
+	frame.top = stack->top;
+	frame.yield = stack->yield;
+	frame.symbol = top;
+	frame.production = nonterminal(pda->g, top)->first - 1;
+	while (next_production(pda, scratch, &frame, word + pos,
+			       search->len - pos, &limited)) {
+		if (n == searcher->children_size) {
+			searcher->children_size = n ? n * 2 : 16;
+			searcher->children =
+				realloc(searcher->children,
+					searcher->children_size *
+					sizeof(*searcher->children));
+			if (!searcher->children) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		snapshot(&searcher->children[n++],
+			 pos + pda->g->productions[frame.production].prefix,
+			 stack, task->level + 1);
+		restore_frame(&frame, word, stack);
+	}
+	if (n)
+		push_tasks(searcher, searcher->children, n);
+
+	return limited ? VERDICT_LIMIT : VERDICT_NAY;
+}
+
+/* Explore tasks until the search of the word is over.  While there are fewer
+ * tasks queued than searchers, the tasks of the top levels are split, so
+ * everybody gets something to do.  The others are explored by the sequential
+ * backtracker.
+ */
+static void search_tasks(struct searcher *searcher)
+{
+	struct search *search = searcher->search;
+	struct scratch *scratch = searcher->scratch;
+	struct stack *stack = &scratch->stack;
+	enum verdict verdict;
+	bool idle = false;
+	struct task task;
+
+	while (!atomic_load(&search->done)) {
+		if (!take_task(searcher, &task)) {
+			if (!idle) {
+				idle = true;
+				atomic_fetch_add(&search->idle, 1);
+			}
+			/* Sleep until somebody queues a task, see
+			 * push_tasks(), or the search is over
+			 */
+			pthread_mutex_lock(&search->lock);
+			while (!atomic_load(&search->queued) &&
+			       atomic_load(&search->pending) &&
+			       !atomic_load(&search->done))
+				pthread_cond_wait(&search->work, &search->lock);
+			pthread_mutex_unlock(&search->lock);
+			if (!atomic_load(&search->pending))
+				break;
+			continue;
+		}
+		if (idle) {
+			idle = false;
+			atomic_fetch_sub(&search->idle, 1);
+		}
+
+		stack->top = 0;
+		stack_reserve(stack, task.top, UINT_MAX);
+		memcpy(stack->content, task.content,
+		       task.top * sizeof(*stack->content));
+		stack->top = task.top;
+		stack->yield = task.yield;
+		free(task.content);
+
+		scratch->memo_full = false;
+		if (task.level < SEARCH_SPLIT_LEVELS &&
+		    atomic_load(&search->queued) < search->count)
+			verdict = split_task(searcher, &task);
+		else
+			verdict = run_pda(search->pda, scratch,
+					  search->word + task.pos,
+					  search->len - task.pos);
+
+		switch (verdict) {
+		case VERDICT_YEP:
+			atomic_store(&search->accepted, true);
+			atomic_store(&search->done, true);
+			search_wake(search);
+			break;
+		case VERDICT_UNDECIDED:
+			atomic_store(&search->undecided, true);
+			atomic_store(&search->done, true);
+			search_wake(search);
+			break;
+		case VERDICT_LIMIT:
+			atomic_store(&search->limited, true);
+			if (scratch->memo_full)
+				atomic_store(&search->memo_full, true);
+			break;
+		default:
+			break;
+		}
+		if (atomic_fetch_sub(&search->pending, 1) == 1)
+			search_wake(search);
+	}
+
+	if (idle)
+		atomic_fetch_sub(&search->idle, 1);
+}
+
+/* A searcher sleeps until the next word comes, and searches it with the
+ * others
+ */
+static void *search_worker(void *arg)
+{
+	struct searcher *searcher = arg;
+	struct search *search = searcher->search;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&search->lock);
+	for (;;) {
+		while (search->generation == generation && !search->quit)
+			pthread_cond_wait(&search->wake, &search->lock);
+		if (search->quit)
+			break;
+		generation = search->generation;
+		pthread_mutex_unlock(&search->lock);
+
+		search_tasks(searcher);
+
+		pthread_mutex_lock(&search->lock);
+		if (!--search->running)
+			pthread_cond_signal(&search->finished);
+	}
+	pthread_mutex_unlock(&search->lock);
+
+	return NULL;
+}
+
+static struct search *search_new(const struct pda *pda)
+{
+	struct search *search = calloc(1, sizeof(*search));
+	struct searcher *searcher;
+	unsigned int i;
+	int err;
+
+	if (search)
+		search->searcher = calloc(pda->parallel,
+					  sizeof(*search->searcher));
+	if (!search || !search->searcher) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	search->pda = pda;
+	search->count = pda->parallel;
+	pthread_mutex_init(&search->lock, NULL);
+	pthread_cond_init(&search->wake, NULL);
+	pthread_cond_init(&search->finished, NULL);
+	pthread_cond_init(&search->work, NULL);
+	for (i = 0; i < search->count; i++) {
+		searcher = &search->searcher[i];
+		searcher->search = search;
+		searcher->scratch = scratch_new(pda);
+		searcher->scratch->searcher = searcher;
+		pthread_mutex_init(&searcher->lock, NULL);
+	}
+
+	/* The searchers wait for the first word right away */
+	for (i = 0; i < search->count; i++) {
+		err = pthread_create(&search->searcher[i].thread, NULL,
+				     search_worker, &search->searcher[i]);
+		if (err) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return search;
+}
+
+/* Search for a derivation of word with pda->parallel threads, starting from
+ * the configuration on the stack of scratch.  Every searcher keeps its own
+ * memo, which is sound, as a configuration only fails in the search as a whole
+ * if all tasks that it handed over fail, too.  The verdict is the same as that
+ * of run_pda(), the budget applies to every thread.
+ */
+static enum verdict run_parallel(const struct pda *pda,
+				 struct scratch *scratch, const char *word,
+				 size_t len)
+{
+	struct search *search = scratch->search;
+	struct scratch *worker;
+	struct task task;
+	unsigned int i;
+
+	if (!search)
+		search = scratch->search = search_new(pda);
+
+	search->word = word;
+	search->len = len;
+	atomic_store(&search->done, false);
+	atomic_store(&search->accepted, false);
+	atomic_store(&search->limited, false);
+	atomic_store(&search->undecided, false);
+	atomic_store(&search->memo_full, false);
+
+	for (i = 0; i < search->count; i++) {
+		worker = search->searcher[i].scratch;
+		worker->depth = scratch->depth;
+		worker->steps = scratch->steps;
+		worker->next_check = 0;
+		worker->deadline = scratch->deadline;
+		if (pda->memoize)
+			memo_clear(&worker->memo);
+	}
+
+	snapshot(&task, 0, &scratch->stack, 0);
+	push_tasks(&search->searcher[0], &task, 1);
+
+	/* Wake the searchers, and wait until all of them are done */
+	pthread_mutex_lock(&search->lock);
+	search->running = search->count;
+	search->generation++;
+	pthread_cond_broadcast(&search->wake);
+	while (search->running)
+		pthread_cond_wait(&search->finished, &search->lock);
+	pthread_mutex_unlock(&search->lock);
+
+	/* Drop the tasks that were cancelled, and add up the figures */
+	for (i = 0; i < search->count; i++) {
+		struct searcher *searcher = &search->searcher[i];
+
+		while (searcher->count > searcher->head)
+			free(searcher->task[--searcher->count].content);
+		searcher->head = searcher->count = 0;
+
+		worker = searcher->scratch;
+		if (worker->steps > scratch->steps)
+			scratch->steps = worker->steps;
+		if (worker->stack.peak > scratch->stack.peak)
+			scratch->stack.peak = worker->stack.peak;
+		if (PDA_STATS && pda->stats) {
+			stats_add(&scratch->stats, &worker->stats);
+			stats_clear(&worker->stats);
+		}
+	}
+	atomic_store(&search->pending, 0);
+	atomic_store(&search->queued, 0);
+	scratch->memo_full = atomic_load(&search->memo_full);
+
+	if (atomic_load(&search->accepted))
+		return VERDICT_YEP;
+	if (atomic_load(&search->undecided))
+		return VERDICT_UNDECIDED;
+	return atomic_load(&search->limited) ? VERDICT_LIMIT : VERDICT_NAY;
+}
+
+/* Decide whether word is element of the language.  Every word starts with the
+ * start symbol as the only element on the stack.  word is an edit of the word
+ * that scratch decided last: the first offset chars of both are the same.  The
+ * Earley engine only works through the rest, the other engines start from
+ * scratch.
+ */
+static enum verdict decide(const struct pda *pda, struct scratch *scratch,
+			   const char *word, size_t len, size_t offset)
+{
+	struct stack *stack = &scratch->stack;
+	enum verdict verdict;
+
+	stack->content[0] = pda->start;
+	stack->top = 1;
+	stack->yield = symbol_yield(pda->g, pda->start);
+
+	/* The budget of the backtracker */
+	scratch->steps = 0;
+	scratch->next_check = pda->max_steps || pda->timeout ? 0 : ULLONG_MAX;
+	if (pda->timeout)
+		scratch->deadline = now_ns() + pda->timeout;
+
+	scratch->words++;
+	scratch->chars += len;
+
+	switch (pda->engine) {
+	case ENGINE_EARLEY:
+		return run_earley(pda, scratch, word, len, offset);
+	case ENGINE_CYK:
+		if (pda->cyk)
+			return run_cyk(pda, scratch, word, len);
+		break;
+	case ENGINE_LL1:
+		if (pda->ll1)
+			return run_ll1(pda, scratch, word, len);
+		break;
+	case ENGINE_SLR:
+		if (pda->lr)
+			return run_lr(pda, scratch, word, len);
+		break;
+	default:
+		break;
+	}
+
+	/* The backtracker, also if the grammar doesn't fit another engine.
+	 * When deepening, a round that hit its maximal depth is repeated with
+	 * twice the depth, as long as the word is left to decide.  A shallow
+	 * derivation is found before the PDA gets lost in a deep branch that
+	 * is doomed to fail.  The memo must not carry over, as configurations
+	 * that failed for lack of depth might succeed in the next round.  A
+	 * round that ran out of memo would run out of it again, though.
+	 */
+	scratch->depth = pda->deepen && pda->deepen < pda->max_depth ?
+			 pda->deepen : pda->max_depth;
+	for (;;) {
+		if (pda->memoize)
+			memo_clear(&scratch->memo);
+		if (pda->parallel > 1)
+			verdict = run_parallel(pda, scratch, word, len);
+		else
+			verdict = run_pda(pda, scratch, word, len);
+		if (verdict != VERDICT_LIMIT || scratch->memo_full ||
+		    scratch->depth == pda->max_depth)
+			return verdict;
+
+		scratch->depth = scratch->depth > pda->max_depth / 2 ?
+				 pda->max_depth : scratch->depth * 2;
+		stack->content[0] = pda->start;
+		stack->top = 1;
+		stack->yield = symbol_yield(pda->g, pda->start);
+	}
+}
+
+/* Like decide(), and the binary trace tells where the steps of every word
+ * begin, and how it was decided
+ */
+static enum verdict recognize_edit(const struct pda *pda,
+				   struct scratch *scratch, const char *word,
+				   size_t len, size_t offset)
+{
+	enum verdict verdict;
+
+	if (PDA_TRACE && pda->trace_file)
+		trace_record(pda, scratch, 0, len, 1, TRACE_WORD);
+	verdict = decide(pda, scratch, word, len, offset);
+	if (PDA_TRACE && pda->trace_file)
+		trace_record(pda, scratch, scratch->steps, verdict, 0,
+			     TRACE_VERDICT);
+
+	return verdict;
+}
+
+static enum verdict recognize(const struct pda *pda, struct scratch *scratch,
+			      const char *word, size_t len)
+{
+	return recognize_edit(pda, scratch, word, len, 0);
+}
+
+/* The library interface, see pda.h.  A grammar bundles everything that
+ * struct pda refers to.
+ */
+struct pda_grammar {
+	struct compiled_grammar cg;
+	struct ll1 ll1;
+	struct cyk cyk;
+	struct lr lr;
+	struct pda pda;
+};
+
+struct pda_ctx {
+	const struct pda_grammar *grammar;
+	struct scratch *scratch;
+};
+
+static const enum engine pda_engines[] = {
+	[PDA_ENGINE_BACKTRACK] = ENGINE_BACKTRACK,
+	[PDA_ENGINE_LL1] = ENGINE_LL1,
+	[PDA_ENGINE_EARLEY] = ENGINE_EARLEY,
+	[PDA_ENGINE_CYK] = ENGINE_CYK,
+	[PDA_ENGINE_SLR] = ENGINE_SLR,
+};
+
+static const enum pda_verdict pda_verdicts[] = {
+	[VERDICT_NAY] = PDA_NAY,
+	[VERDICT_YEP] = PDA_YEP,
+	[VERDICT_LIMIT] = PDA_LIMIT,
+	[VERDICT_UNDECIDED] = PDA_UNDECIDED,
+};
+
+/* Set up pda for its freshly loaded grammar, for the library and the command
+ * line tool alike: normalize the grammar if asked to, and build the table of
+ * the engine.  If the grammar doesn't permit one, the table stays NULL, and
+ * pda falls back to backtracking.  If before is not NULL, it keeps the grammar
+ * from before the normalization, otherwise that one is freed.
+ */
+static void setup_grammar(struct pda_grammar *grammar, bool normalize,
+			  bool inline_nonterms,
+			  struct compiled_grammar *before)
+{
+	struct pda *pda = &grammar->pda;
+	struct compiled_grammar normalized;
+
+	if (normalize) {
+		normalize_grammar(&grammar->cg, &pda->start, inline_nonterms,
+				  &normalized);
+		if (before)
+			*before = grammar->cg;
+		else
+			free_grammar(&grammar->cg);
+		grammar->cg = normalized;
+	}
+
+	pda->g = &grammar->cg;
+	pda->cyclic = has_cycles(pda->g);
+	if (!pda->max_depth)
+		pda->max_depth = STACK_DEFAULT_MAX_DEPTH;
+
+	if (pda->engine == ENGINE_LL1 &&
+	    build_ll1(&grammar->cg, pda->start, &grammar->ll1))
+		pda->ll1 = &grammar->ll1;
+	if (pda->engine == ENGINE_CYK &&
+	    build_cyk(&grammar->cg, pda->start, &grammar->cyk))
+		pda->cyk = &grammar->cyk;
+	if (pda->engine == ENGINE_SLR &&
+	    build_lr(&grammar->cg, pda->start, &grammar->lr))
+		pda->lr = &grammar->lr;
+}
+
+/* Set up the engine of a freshly loaded grammar */
+static struct pda_grammar *pda_setup(struct pda_grammar *grammar,
+				     const struct pda_options *options)
+{
+	static const struct pda_options defaults = {
+		.engine = PDA_ENGINE_BACKTRACK,
+	};
+	struct pda *pda = &grammar->pda;
+
+	if (!options)
+		options = &defaults;
+	if ((unsigned int)options->engine > PDA_ENGINE_SLR) {
+		fprintf(stderr, "Unknown engine: %d\n", options->engine);
+		free_grammar(&grammar->cg);
+		free(grammar);
+		return NULL;
+	}
+
+	pda->engine = pda_engines[options->engine];
+	pda->memoize = options->memoize;
+	pda->max_depth = options->max_depth;
+	pda->max_steps = options->max_steps;
+	pda->timeout = options->timeout_ms * 1000000ULL;
+	pda->deepen = options->deepen;
+	pda->parallel = options->threads;
+	setup_grammar(grammar, options->normalize, false, NULL);
+
+	return grammar;
+}
+
+static struct pda_grammar *pda_grammar_new(void)
+{
+	struct pda_grammar *grammar = calloc(1, sizeof(*grammar));
+
+	if (!grammar) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	return grammar;
+}
+
+struct pda_grammar *pda_compile(const char *text, size_t len,
+				const struct pda_options *options)
+{
+	struct pda_grammar *grammar = pda_grammar_new();
+	bool ret;
+	FILE *f;
+
+	if (!text) {
+		compile_grammar(wtf, &grammar->cg, &grammar->pda.start);
+		return pda_setup(grammar, options);
+	}
+
+	f = fmemopen((void *)text, len, "r");
+	if (!f) {
+		perror("fmemopen");
+		free(grammar);
+		return NULL;
+	}
+	ret = parse_grammar(f, "grammar", &grammar->cg, &grammar->pda.start);
+	fclose(f);
+	if (!ret) {
+		free(grammar);
+		return NULL;
+	}
+
+	return pda_setup(grammar, options);
+}
+
+struct pda_grammar *pda_load(const char *file,
+			     const struct pda_options *options)
+{
+	struct pda_grammar *grammar = pda_grammar_new();
+
+	if (!load_grammar(file, &grammar->cg, &grammar->pda.start)) {
+		free(grammar);
+		return NULL;
+	}
+
+	return pda_setup(grammar, options);
+}
+
+void pda_free(struct pda_grammar *grammar)
+{
+	if (!grammar)
+		return;
+
+	if (grammar->pda.ll1)
+		free_ll1(&grammar->ll1);
+	if (grammar->pda.cyk)
+		free_cyk(&grammar->cyk);
+	if (grammar->pda.lr)
+		free_lr(&grammar->lr);
+	free_grammar(&grammar->cg);
+	free(grammar);
+}
+
+struct pda_ctx *pda_ctx_new(const struct pda_grammar *grammar)
+{
+	struct pda_ctx *ctx = malloc(sizeof(*ctx));
+
+	if (!ctx) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	ctx->grammar = grammar;
+	ctx->scratch = scratch_new(&grammar->pda);
+
+	return ctx;
+}
+
+enum pda_verdict pda_recognize(struct pda_ctx *ctx, const char *buf,
+			       size_t len)
+{
+	return pda_verdicts[recognize(&ctx->grammar->pda, ctx->scratch, buf,
+				      len)];
+}
+
+enum pda_verdict pda_recognize_edit(struct pda_ctx *ctx, const char *buf,
+				    size_t len, size_t offset)
+{
+	return pda_verdicts[recognize_edit(&ctx->grammar->pda, ctx->scratch,
+					   buf, len, offset)];
+}
+
+void pda_ctx_free(struct pda_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	scratch_free(ctx->scratch);
+	free(ctx);
+}
+
+/* Everything below is the command line tool, which the library leaves out */
+#ifndef PDA_LIBRARY
+
+static const char *const verdict_names[] = {
+	[VERDICT_NAY] = "Nay",
+	[VERDICT_YEP] = "Yep",
+	[VERDICT_LIMIT] = "Limit",
+	[VERDICT_UNDECIDED] = "Undecided",
+};
+
+static void json_char(FILE *stream, unsigned char c)
+{
+	if (c == '"' || c == '\\')
+		fprintf(stream, "\\%c", c);
+	else if (c < 0x20 || c >= 0x7f)
+		fprintf(stream, "\\u%04x", c);
+	else
+		fputc(c, stream);
+}
+
+static void json_string(FILE *stream, const char *string)
+{
+	for (; *string; string++)
+		json_char(stream, *string);
+}
+
+static void json_production(FILE *stream, const struct compiled_grammar *cg,
+			    const struct production *p)
+{
+	unsigned int i;
+	symbol_t symbol;
+
+	json_string(stream, nonterminal_name(cg, p->lhs));
+	fprintf(stream, " -> ");
+	for (i = 0; i < p->len; i++) {
+		symbol = production_symbol(cg, p, i);
+		if (is_nonterminal(symbol))
+			json_string(stream, nonterminal_name(cg, symbol));
+		else
+			json_char(stream, symbol);
+	}
+}
+
+/* Print the statistics on stderr, so they don't mix up with the verdicts.
+ * The expansions of a nonterminal are the sum of the expansions of its
+ * productions.
+ */
+static void print_stats(const struct pda *pda, const struct stats *stats,
+			enum stats_format format)
+{
+	const struct compiled_grammar *cg = pda->g;
+	const struct nonterminal *nterm;
+	unsigned long long expansions;
+	unsigned int i, j;
+
+	if (format == STATS_TEXT) {
+		fprintf(stderr, "Statistics:\n"
+				"  matched chars     %llu\n"
+				"  mismatches        %llu\n"
+				"  pruned            %llu\n"
+				"  backtracks        %llu\n"
+				"  memo hits         %llu\n"
+				"  max stack height  %u\n"
+				"  max depth         %u\n",
+			stats->matches, stats->mismatches, stats->pruned,
+			stats->backtracks, stats->memo_hits, stats->height,
+			stats->depth);
+
+		fprintf(stderr, "  expansions per nonterminal:\n");
+		for (i = 0; i < cg->num_nonterms; i++) {
+			nterm = &cg->nonterm[i];
+			for (expansions = 0, j = 0; j < nterm->count; j++)
+				expansions += stats->expansions[nterm->first + j];
+			fprintf(stderr, "    %12llu  %s\n", expansions,
+				cg->names + nterm->name);
+		}
+
+		fprintf(stderr, "  expansions and failures per production:\n");
+		for (i = 0; i < cg->num_productions; i++) {
+			fprintf(stderr, "    %12llu %12llu  ",
+				stats->expansions[i], stats->failures[i]);
+			print_production(stderr, cg, &cg->productions[i]);
+			fprintf(stderr, "\n");
+		}
+		return;
+	}
+
+	fprintf(stderr, "{\"matches\": %llu, \"mismatches\": %llu, "
+			"\"pruned\": %llu, \"backtracks\": %llu, "
+			"\"memo_hits\": %llu, \"max_height\": %u, "
+			"\"max_depth\": %u,\n",
+		stats->matches, stats->mismatches, stats->pruned,
+		stats->backtracks, stats->memo_hits, stats->height,
+		stats->depth);
+
+	fprintf(stderr, " \"nonterminals\": [");
+	for (i = 0; i < cg->num_nonterms; i++) {
+		nterm = &cg->nonterm[i];
+		for (expansions = 0, j = 0; j < nterm->count; j++)
+			expansions += stats->expansions[nterm->first + j];
+		fprintf(stderr, "%s\n  {\"name\": \"", i ? "," : "");
+		json_string(stderr, cg->names + nterm->name);
+		fprintf(stderr, "\", \"expansions\": %llu}", expansions);
+	}
+
+	fprintf(stderr, "],\n \"productions\": [");
+	for (i = 0; i < cg->num_productions; i++) {
+		fprintf(stderr, "%s\n  {\"production\": \"", i ? "," : "");
+		json_production(stderr, cg, &cg->productions[i]);
+		fprintf(stderr, "\", \"expansions\": %llu, \"failures\": %llu}",
+			stats->expansions[i], stats->failures[i]);
+	}
+	fprintf(stderr, "]}\n");
+}
+
+/* Returns the grammar that the engine of pda actually works with */
+static const struct compiled_grammar *engine_grammar(const struct pda *pda)
+{
+	if (pda->engine == ENGINE_LL1 && pda->ll1)
+		return &pda->ll1->g;
+	return pda->g;
+}
+
+/* Print the leftmost derivation of the word that the PDA just accepted, one
+ * production per line.  The frames of the nonterminals are exactly the
+ * productions that the PDA applied, in the order it applied them.
+ */
+static void print_derivation(const struct pda *pda,
+			     const struct scratch *scratch)
+{
+	const struct compiled_grammar *cg = engine_grammar(pda);
+	const struct frame *frame;
+	unsigned int i;
+
+	for (i = 0; i < scratch->frames.count; i++) {
+		frame = &scratch->frames.frame[i];
+		if (frame->production == FRAME_TERMINAL)
+			continue;
+		printf("  ");
+		print_production(stdout, cg, &cg->productions[frame->production]);
+		printf("\n");
+	}
+}
+
+static struct tree_node *new_node(struct arena *arena, symbol_t symbol,
+				  struct tree_node *parent)
+{
+	struct tree_node *node = arena_alloc(arena, sizeof(*node));
+
+	node->symbol = symbol;
+	node->depth = parent ? parent->depth + 1 : 0;
+	node->parent = parent;
+	node->child = NULL;
+	node->sibling = NULL;
+
+	return node;
+}
+
+/* Returns the nonterminal that a leftmost derivation expands after node: the
+ * first nonterminal among the children of node, or otherwise among the
+ * siblings that follow node or one of its ancestors.
+ */
+static struct tree_node *next_open(struct tree_node *node)
+{
+	struct tree_node *n = node->child;
+
+	for (;;) {
+		for (; n; n = n->sibling)
+			if (is_nonterminal(n->symbol))
+				return n;
+		if (!node)
+			return NULL;
+		n = node->sibling;
+		node = node->parent;
+	}
+}
+
+/* Build the parse tree of the word that the PDA just accepted by replaying its
+ * leftmost derivation.  The tree lives in the arena of scratch until the next
+ * tree is built.
+ */
+static struct tree_node *build_tree(const struct pda *pda,
+				    struct scratch *scratch)
+{
+	const struct compiled_grammar *cg = engine_grammar(pda);
+	struct tree_node *root, *node, **link;
+	const struct production *p;
+	const struct frame *frame;
+	unsigned int i, j;
+
+	arena_reset(&scratch->arena);
+	root = node = new_node(&scratch->arena, pda->start, NULL);
+
+	for (i = 0; i < scratch->frames.count && node; i++) {
+		frame = &scratch->frames.frame[i];
+		if (frame->production == FRAME_TERMINAL)
+			continue;
+
+		p = &cg->productions[frame->production];
+		link = &node->child;
+		for (j = 0; j < p->len; j++) {
+			*link = new_node(&scratch->arena,
+					 production_symbol(cg, p, j), node);
+			link = &(*link)->sibling;
+		}
+		node = next_open(node);
+	}
+
+	return root;
+}
+
+/* Print the tree in preorder, one node per line, children indented */
+static void print_tree(const struct compiled_grammar *cg,
+		       const struct tree_node *node)
+{
+	while (node) {
+		printf("%*s", 2 * (node->depth + 1), "");
+		if (is_nonterminal(node->symbol))
+			print_symbol(stdout, cg, node->symbol);
+		else
+			print_char(stdout, node->symbol);
+		printf("\n");
+
+		if (node->child) {
+			node = node->child;
+			continue;
+		}
+		while (node && !node->sibling)
+			node = node->parent;
+		if (node)
+			node = node->sibling;
+	}
+}
+
+/* Print the verdict of a word, and how it was derived if we were asked to */
+static void print_verdict(const struct pda *pda, struct scratch *scratch,
+			  enum verdict verdict)
+{
+	puts(verdict_names[verdict]);
+	if (verdict != VERDICT_YEP)
+		return;
+
+	switch (pda->derivation) {
+	case DERIVATION_LIST:
+		print_derivation(pda, scratch);
+		break;
+	case DERIVATION_TREE:
+		print_tree(engine_grammar(pda), build_tree(pda, scratch));
+		break;
+	default:
+		break;
+	}
+}
+
+/* Read words from stream, one per line, and print one verdict per line.
+ * Returns true if all words were accepted.
+ */
+static bool run_batch(const struct pda *pda, struct scratch *scratch,
+		      FILE *stream)
+{
+	size_t size = 0, last_size = 0, last_len = 0, offset, tmp_size;
+	char *line = NULL, *last = NULL, *tmp;
+	enum verdict verdict;
+	bool ret = true;
+	ssize_t len;
+
+	while ((len = getline(&line, &size, stream)) != -1) {
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (!pda->incremental) {
+			verdict = recognize(pda, scratch, line, len);
+		} else {
+			/* The edit starts where the line differs from the
+			 * last one.  Keep the line for the next comparison by
+			 * swapping the buffers.
+			 */
+			for (offset = 0; offset < (size_t)len &&
+			     offset < last_len; offset++)
+				if (line[offset] != last[offset])
+					break;
+			verdict = recognize_edit(pda, scratch, line, len,
+						 offset);
+
+			tmp = last;
+			last = line;
+			line = tmp;
+			tmp_size = last_size;
+			last_size = size;
+			size = tmp_size;
+			last_len = len;
+		}
+		print_verdict(pda, scratch, verdict);
+		ret &= verdict == VERDICT_YEP;
+	}
+	free(line);
+	free(last);
+
+	return ret;
+}
+
+/* For multithreaded batch runs, we read BATCH_BLOCK lines at once, let the
+ * workers decide them, and print the verdicts in input order.  Workers grab
+ * BATCH_CHUNK words at a time.  The workers are started once per batch, and
+ * wait for the next block in between.
+ */
+#define BATCH_BLOCK 65536
+#define BATCH_CHUNK 64
+
+struct batch {
+	const struct pda *pda;
+
+	/* All lines of the current block, back to back */
+	char *buffer;
+	size_t buffer_used;
+	size_t buffer_size;
+
+	size_t *offset;
+	size_t *length;
+	unsigned char *verdict;
+	unsigned int count;
+
+	atomic_uint next;
+
+	/* Every block has a generation of its own, and wakes the workers.
+	 * running counts those that still work on it, the last one signals
+	 * finished.  done tells them to end.
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t finished;
+	unsigned long generation;
+	unsigned int running;
+	bool done;
+};
+
+struct worker {
+	pthread_t thread;
+	struct batch *batch;
+	struct scratch *scratch;
+};
+
+/* Decide the words of the current block, until there are none left */
+static void batch_block(struct worker *worker)
+{
+	struct batch *batch = worker->batch;
+	unsigned int i, end;
+
+	for (;;) {
+		i = atomic_fetch_add(&batch->next, BATCH_CHUNK);
+		if (i >= batch->count)
+			break;
+
+		end = i + BATCH_CHUNK;
+		if (end > batch->count)
+			end = batch->count;
+		for (; i < end; i++)
+			batch->verdict[i] =
+				recognize(batch->pda, worker->scratch,
+					  batch->buffer + batch->offset[i],
+					  batch->length[i]);
+	}
+}
+
+static void *batch_worker(void *arg)
+{
+	struct worker *worker = arg;
+	struct batch *batch = worker->batch;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&batch->lock);
+	for (;;) {
+		while (batch->generation == generation && !batch->done)
+			pthread_cond_wait(&batch->ready, &batch->lock);
+		if (batch->done)
+			break;
+		generation = batch->generation;
+		pthread_mutex_unlock(&batch->lock);
+
+		batch_block(worker);
+
+		pthread_mutex_lock(&batch->lock);
+		if (!--batch->running)
+			pthread_cond_signal(&batch->finished);
+	}
+	pthread_mutex_unlock(&batch->lock);
+
+	return NULL;
+}
+
+/* Add the figures of a worker to those of scratch */
+static void merge_scratch(const struct pda *pda, struct scratch *scratch,
+			  const struct scratch *worker)
+{
+	scratch->words += worker->words;
+	scratch->chars += worker->chars;
+	if (worker->stack.peak > scratch->stack.peak)
+		scratch->stack.peak = worker->stack.peak;
+	if (PDA_STATS && pda->stats)
+		stats_add(&scratch->stats, &worker->stats);
+}
+
+/* Multithreaded version of run_batch().  Every worker owns its scratch memory,
+ * the grammar is shared by all of them, as nobody modifies it.  In the end, the
+ * figures of all workers are added to those of scratch.
+ */
+static bool run_batch_threaded(const struct pda *pda, struct scratch *scratch,
+			       unsigned int jobs, FILE *stream)
+{
+	struct worker *workers;
+	struct batch batch = {
+		.pda = pda,
+	};
+	unsigned int i;
+	size_t size = 0;
+	char *line = NULL;
+	bool ret = true;
+	ssize_t len;
+	int err;
+
+	workers = calloc(jobs, sizeof(*workers));
+	batch.offset = malloc(BATCH_BLOCK * sizeof(*batch.offset));
+	batch.length = malloc(BATCH_BLOCK * sizeof(*batch.length));
+	batch.verdict = malloc(BATCH_BLOCK * sizeof(*batch.verdict));
+	if (!workers || !batch.offset || !batch.length || !batch.verdict) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.ready, NULL);
+	pthread_cond_init(&batch.finished, NULL);
+	for (i = 0; i < jobs; i++) {
+		workers[i].batch = &batch;
+		workers[i].scratch = scratch_new(pda);
+		err = pthread_create(&workers[i].thread, NULL, batch_worker,
+				     &workers[i]);
+		if (err) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	do {
+		/* Read the next block of lines */
+		batch.count = 0;
+		batch.buffer_used = 0;
+		while (batch.count < BATCH_BLOCK &&
+		       (len = getline(&line, &size, stream)) != -1) {
+			if (len && line[len - 1] == '\n')
+				line[--len] = '\0';
+
+			while (batch.buffer_used + len + 1 > batch.buffer_size) {
+				batch.buffer_size = batch.buffer_size ?
+						    batch.buffer_size * 2 :
+						    1 << 20;
+				batch.buffer = realloc(batch.buffer,
+						       batch.buffer_size);
+				if (!batch.buffer) {
+					perror("realloc");
+					exit(EXIT_FAILURE);
+				}
+			}
+			memcpy(batch.buffer + batch.buffer_used, line, len + 1);
+			batch.offset[batch.count] = batch.buffer_used;
+			batch.length[batch.count++] = len;
+			batch.buffer_used += len + 1;
+		}
+
+		if (!batch.count)
+			break;
+
+		/* Hand the block to the workers, and wait until they're
+		 * through with it
+		 */
+		atomic_store(&batch.next, 0);
+		pthread_mutex_lock(&batch.lock);
+		batch.running = jobs;
+		batch.generation++;
+		pthread_cond_broadcast(&batch.ready);
+		while (batch.running)
+			pthread_cond_wait(&batch.finished, &batch.lock);
+		pthread_mutex_unlock(&batch.lock);
+
+		for (i = 0; i < batch.count; i++) {
+			puts(verdict_names[batch.verdict[i]]);
+			ret &= batch.verdict[i] == VERDICT_YEP;
+		}
+	} while (batch.count == BATCH_BLOCK);
+
+	pthread_mutex_lock(&batch.lock);
+	batch.done = true;
+	pthread_cond_broadcast(&batch.ready);
+	pthread_mutex_unlock(&batch.lock);
+
+	for (i = 0; i < jobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+		merge_scratch(pda, scratch, workers[i].scratch);
+		scratch_free(workers[i].scratch);
+	}
+	pthread_cond_destroy(&batch.finished);
+	pthread_cond_destroy(&batch.ready);
+	pthread_mutex_destroy(&batch.lock);
+	free(workers);
+	free(batch.buffer);
+	free(batch.offset);
+	free(batch.length);
+	free(batch.verdict);
+	free(line);
+
+	return ret;
+}
+
+/* The server of -l answers requests for as long as it runs, so the grammar is
+ * loaded and compiled only once.  It serves stdin and stdout, or every client
+ * that connects to a Unix socket.  A request is a header line and the word:
+ *
+ *   <id> <length>\n<length chars>
+ *
+ * The id is any string of up to SERVER_ID_SIZE - 1 chars without white space,
+ * the answer is '<id> <verdict>\n'.  Clients may send as many requests as they
+ * like without waiting for the answers.  A reader per client puts them into a
+ * queue, and the workers answer them as soon as they are decided, so answers
+ * may come in another order than the requests.  A writer per client writes
+ * them out, so a client that doesn't read its answers never stalls a worker.
+ * It stalls its own reader, though, so clients must keep reading answers while
+ * they send.  If a header is malformed, the client gets
+ * '? Error\n', and the server hangs up.
+ */
+#define SERVER_ID_SIZE 64
+#define SERVER_MAX_WORD (256 << 20)
+
+/* Readers wait while SERVER_QUEUE_SIZE requests are pending, so a client
+ * can't make the queue grow without bounds.  Every answer is written as soon
+ * as it is decided, as another request of the client may take arbitrarily
+ * long.  The buffer of the answers starts with SERVER_ANSWERS_SIZE bytes, and
+ * a reader waits while SERVER_MAX_ANSWERS bytes of answers are yet to be
+ * written.
+ */
+#define SERVER_QUEUE_SIZE 4096
+#define SERVER_ANSWERS_SIZE 4096
+#define SERVER_MAX_ANSWERS (1 << 20)
+
+struct request {
+	struct request *next;
+	struct client *client;
+	char id[SERVER_ID_SIZE];
+	char *word;
+	size_t len;
+};
+
+struct server {
+	const struct pda *pda;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t room;
+	struct request *head;
+	struct request *tail;
+	unsigned int count;
+
+	/* No more requests will come, the workers quit once the queue is
+	 * empty
+	 */
+	bool done;
+};
+
+/* A client lives as long as its reader runs, or any of its answers is left to
+ * write.  Its writer is the last one, and frees it.
+ */
+struct client {
+	struct server *server;
+	FILE *in;
+	int out;
+	pthread_t writer;
+
+	pthread_mutex_t lock;
+	/* There are answers to write, or the client is done */
+	pthread_cond_t ready;
+	/* The writer took the answers */
+	pthread_cond_t room;
+	char *answers;
+	size_t answers_used;
+	size_t answers_size;
+	unsigned int pending;
+	bool reading;
+	bool broken;
+};
+
+struct server_worker {
+	pthread_t thread;
+	struct server *server;
+	struct scratch *scratch;
+};
+
+static void client_answer(struct client *client, const char *id,
+			  const char *answer)
+{
+	size_t len = strlen(id) + strlen(answer) + 2;
+
+	if (client->answers_used + len > client->answers_size) {
+		client->answers_size = client->answers_size ?
+				       client->answers_size * 2 :
+				       SERVER_ANSWERS_SIZE;
+		client->answers = realloc(client->answers,
+					  client->answers_size);
+		if (!client->answers) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	client->answers_used += sprintf(client->answers +
+					client->answers_used, "%s %s\n",
+					id, answer);
+}
+
+/* Write out the answers of the client, until its reader is done and every
+ * request is answered.  The workers collect new answers while the writer
+ * writes without the lock held, and the writer takes all of them in one go
+ * for the next write.  If the client went away, its answers are dropped.
+ */
+static void *client_writer(void *arg)
+{
+	struct client *client = arg;
+	size_t size = 0, written_size, used, done;
+	char *buffer = NULL, *written;
+	bool broken = false;
+	ssize_t ret;
+
+	pthread_mutex_lock(&client->lock);
+	for (;;) {
+		while (!client->answers_used &&
+		       (client->reading || client->pending))
+			pthread_cond_wait(&client->ready, &client->lock);
+		if (!client->answers_used)
+			break;
+
+		/* Trade the buffer of the answers for the one we wrote */
+		used = client->answers_used;
+		written = client->answers;
+		client->answers = buffer;
+		buffer = written;
+		written_size = client->answers_size;
+		client->answers_size = size;
+		size = written_size;
+		client->answers_used = 0;
+		pthread_cond_signal(&client->room);
+		pthread_mutex_unlock(&client->lock);
+
+		for (done = 0; !broken && done < used; ) {
+			ret = write(client->out, buffer + done, used - done);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret < 0)
+				broken = true;
+			else
+				done += ret;
+		}
+
+		pthread_mutex_lock(&client->lock);
+		if (broken && !client->broken) {
+			client->broken = true;
+			pthread_cond_signal(&client->room);
+		}
+	}
+	pthread_mutex_unlock(&client->lock);
+
+	pthread_cond_destroy(&client->room);
+	pthread_cond_destroy(&client->ready);
+	pthread_mutex_destroy(&client->lock);
+	fclose(client->in);
+	if (client->out != STDOUT_FILENO)
+		close(client->out);
+	free(client->answers);
+	free(buffer);
+	free(client);
+
+	return NULL;
+}
+
+static void *server_worker(void *arg)
+{
+	struct server_worker *worker = arg;
+	struct server *server = worker->server;
+	struct request *request;
+	struct client *client;
+	enum verdict verdict;
+
+	for (;;) {
+		pthread_mutex_lock(&server->lock);
+		while (!server->head && !server->done)
+			pthread_cond_wait(&server->ready, &server->lock);
+		request = server->head;
+		if (!request) {
+			pthread_mutex_unlock(&server->lock);
+			break;
+		}
+		server->head = request->next;
+		if (!server->head)
+			server->tail = NULL;
+		server->count--;
+		pthread_cond_signal(&server->room);
+		pthread_mutex_unlock(&server->lock);
+
+		verdict = recognize(server->pda, worker->scratch,
+				    request->word, request->len);
+
+		client = request->client;
+		pthread_mutex_lock(&client->lock);
+		client_answer(client, request->id, verdict_names[verdict]);
+		client->pending--;
+		pthread_cond_signal(&client->ready);
+		pthread_mutex_unlock(&client->lock);
+
+		free(request->word);
+		free(request);
+	}
+
+	return NULL;
+}
+
+/* Parse the header of a request.  Returns false if it's malformed. */
+static bool parse_request(const char *line, struct request *request)
+{
+	unsigned long long len;
+	int end = 0;
+
+	if (sscanf(line, "%63s %llu%n", request->id, &len, &end) != 2 ||
+	    strcmp(line + end, "\n") || len > SERVER_MAX_WORD)
+		return false;
+
+	request->len = len;
+	return true;
+}
+
+/* Read the requests of a client and queue them, until it hangs up */
+static void *server_reader(void *arg)
+{
+	struct client *client = arg;
+	struct server *server = client->server;
+	struct request *request;
+	char *line = NULL;
+	size_t size = 0;
+
+	while (getline(&line, &size, client->in) != -1) {
+		request = malloc(sizeof(*request));
+		if (!request) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+
+		if (!parse_request(line, request)) {
+			free(request);
+			pthread_mutex_lock(&client->lock);
+			client_answer(client, "?", "Error");
+			pthread_mutex_unlock(&client->lock);
+			break;
+		}
+
+		request->word = malloc(request->len + 1);
+		if (!request->word) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		if (fread(request->word, 1, request->len, client->in) !=
+		    request->len) {
+			free(request->word);
+			free(request);
+			break;
+		}
+		request->word[request->len] = '\0';
+		request->client = client;
+		request->next = NULL;
+
+		/* Don't take more requests than the client takes answers */
+		pthread_mutex_lock(&client->lock);
+		while (client->answers_used >= SERVER_MAX_ANSWERS &&
+		       !client->broken)
+			pthread_cond_wait(&client->room, &client->lock);
+		client->pending++;
+		pthread_mutex_unlock(&client->lock);
+
+		pthread_mutex_lock(&server->lock);
+		while (server->count >= SERVER_QUEUE_SIZE)
+			pthread_cond_wait(&server->room, &server->lock);
+		if (server->tail)
+			server->tail->next = request;
+		else
+			server->head = request;
+		server->tail = request;
+		server->count++;
+		pthread_cond_signal(&server->ready);
+		pthread_mutex_unlock(&server->lock);
+	}
+	free(line);
+
+	pthread_mutex_lock(&client->lock);
+	client->reading = false;
+	pthread_cond_signal(&client->ready);
+	pthread_mutex_unlock(&client->lock);
+
+	return NULL;
+}
+
+/* Set up a client and start its writer */
+static struct client *new_client(struct server *server, FILE *in, int out)
+{
+	struct client *client = calloc(1, sizeof(*client));
+	int err;
+
+	if (!client) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	client->server = server;
+	client->in = in;
+	client->out = out;
+	client->reading = true;
+	pthread_mutex_init(&client->lock, NULL);
+	pthread_cond_init(&client->ready, NULL);
+	pthread_cond_init(&client->room, NULL);
+
+	err = pthread_create(&client->writer, NULL, client_writer, client);
+	if (err) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+
+	return client;
+}
+
+/* Accept clients on the Unix socket at path, and give every one a reader of
+ * its own.  Only returns on errors.
+ */
+static bool serve_socket(struct server *server, const char *path)
+{
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	struct client *client;
+	pthread_t thread;
+	struct stat st;
+	int fd, conn, err;
+	FILE *in;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: Socket path too long\n", path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+
+	/* A socket that a former server left behind is in the way */
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, SOMAXCONN)) {
+		perror(path);
+		return false;
+	}
+
+	for (;;) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			close(fd);
+			return false;
+		}
+
+		/* The reader gets a stream of its own, so closing it doesn't
+		 * close the socket that the workers answer on
+		 */
+		in = fdopen(dup(conn), "r");
+		if (!in) {
+			perror("fdopen");
+			exit(EXIT_FAILURE);
+		}
+
+		client = new_client(server, in, conn);
+		pthread_detach(client->writer);
+		err = pthread_create(&thread, NULL, server_reader, client);
+		if (err) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(err));
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(thread);
+	}
+}
+
+/* Run the server of -l with jobs workers, on stdin and stdout if path is "-".
+ * That one ends when stdin does, and the figures of the workers end up in
+ * scratch.
+ */
+static bool run_server(const struct pda *pda, struct scratch *scratch,
+		       unsigned int jobs, const char *path)
+{
+	struct server_worker *workers;
+	struct server server = {
+		.pda = pda,
+	};
+	struct client *client;
+	bool ret = true;
+	pthread_t writer;
+	unsigned int i;
+	int err;
+
+	/* A client that hangs up must not take the server with it */
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.ready, NULL);
+	pthread_cond_init(&server.room, NULL);
+
+	workers = calloc(jobs, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < jobs; i++) {
+		workers[i].server = &server;
+		workers[i].scratch = scratch_new(pda);
+		err = pthread_create(&workers[i].thread, NULL, server_worker,
+				     &workers[i]);
+		if (err) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (strcmp(path, "-")) {
+		ret = serve_socket(&server, path);
+	} else {
+		/* All answers must be out before we return */
+		client = new_client(&server, stdin, STDOUT_FILENO);
+		writer = client->writer;
+		server_reader(client);
+		pthread_join(writer, NULL);
+	}
+
+	pthread_mutex_lock(&server.lock);
+	server.done = true;
+	pthread_cond_broadcast(&server.ready);
+	pthread_mutex_unlock(&server.lock);
+
+	for (i = 0; i < jobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+		merge_scratch(pda, scratch, workers[i].scratch);
+		scratch_free(workers[i].scratch);
+	}
+	free(workers);
+	pthread_cond_destroy(&server.room);
+	pthread_cond_destroy(&server.ready);
+	pthread_mutex_destroy(&server.lock);
+
+	return ret;
+}
+
+/* A word that we read from a file.  If possible, the file is mapped into
+ * memory, so even huge words are never copied.  Otherwise, e.g., for pipes,
+ * we read it in chunks into a buffer.
+ */
+struct input {
+	char *data;
+	size_t len;
+	size_t mapped;
+};
+
+static bool open_input(const char *name, struct input *input)
+{
+	size_t size = 0;
+	struct stat st;
+	ssize_t ret;
+	int fd;
+
+	memset(input, 0, sizeof(*input));
+	fd = strcmp(name, "-") ? open(name, O_RDONLY) : STDIN_FILENO;
+	if (fd < 0) {
+		perror(name);
+		return false;
+	}
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		input->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				   fd, 0);
+		if (input->data != MAP_FAILED) {
+			/* The engines read the input front to back */
+			madvise(input->data, st.st_size, MADV_SEQUENTIAL);
+			input->len = input->mapped = st.st_size;
+			goto out;
+		}
+		input->data = NULL;
+	}
+
+	for (;;) {
+		if (input->len == size) {
+			size = size ? size * 2 : 1 << 16;
+			input->data = realloc(input->data, size);
+			if (!input->data) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		ret = read(fd, input->data + input->len, size - input->len);
+		if (ret < 0) {
+			perror(name);
+			free(input->data);
+			if (fd != STDIN_FILENO)
+				close(fd);
+			return false;
+		}
+		if (!ret)
+			break;
+		input->len += ret;
+	}
+
+out:
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	/* Files usually end with a newline that doesn't belong to the word */
+	if (input->len && input->data[input->len - 1] == '\n')
+		input->len--;
+
+	return true;
+}
+
+static void close_input(struct input *input)
+{
+	if (input->mapped)
+		munmap(input->data, input->mapped);
+	else
+		free(input->data);
+}
+
+/* Returns the peak resident set size in KiB.  The maximal resident set size
+ * that getrusage() reports may include the memory of the process that forked
+ * us, so prefer the high water mark of our own memory, if Linux tells it.
+ */
+static long peak_memory(void)
+{
+	struct rusage usage;
+	char line[256];
+	long kib = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/status", "r");
+	if (f) {
+		while (fgets(line, sizeof(line), f))
+			if (sscanf(line, "VmHWM: %ld kB", &kib) == 1)
+				break;
+		fclose(f);
+	}
+
+	if (kib < 0 && !getrusage(RUSAGE_SELF, &usage))
+		kib = usage.ru_maxrss;
+
+	return kib;
+}
+
+/* Print the figures of a benchmark run, which took ns nanoseconds, on stderr */
+static void print_bench(const struct scratch *scratch, unsigned long long ns)
+{
+	if (!ns)
+		ns = 1;
+
+	fprintf(stderr, "bench: words=%lu chars=%llu ns=%llu words/s=%.0f "
+			"ns/char=%.3f depth=%u rss=%ldKiB\n",
+		scratch->words, scratch->chars, ns,
+		scratch->words * 1e9 / ns,
+		scratch->chars ? (double)ns / scratch->chars : 0.0,
+		scratch->stack.peak, peak_memory());
+}
+
+/* Code generation.  Instead of interpreting the grammar, a recognizer can be
+ * specialized to it: generate_recognizer() writes a C file with one function
+ * per nonterminal that tries the productions of the nonterminal one after
+ * another.  Everything that next_production() looks up in the compiled
+ * grammar becomes a constant: the FIRST sets are inlined comparisons or
+ * bitmaps, the yields are numbers, the leading terminals are compared
+ * char by char, and the rest of a production is pushed by plain stores.  The
+ * driver around them is run_pda() without memoization, trace and statistics,
+ * so the generated recognizer explores the same paths and comes to the same
+ * verdicts, including Limit.
+ *
+ * The file defines pda_generated_recognize(), and, unless it's compiled with
+ * -DPDA_GEN_NO_MAIN, a main() that checks the lines of a file or stdin.
+ */
+
+/* Write s into a C comment, which must neither end early nor nest */
+static void gen_comment(FILE *f, const char *s)
+{
+	for (; *s; s++) {
+		fputc(*s, f);
+		if ((s[0] == '*' && s[1] == '/') || (s[0] == '/' && s[1] == '*'))
+			fputc('\\', f);
+	}
+}
+
+/* Write production p into a C comment */
+static void gen_production(FILE *f, const struct compiled_grammar *cg,
+			   const struct production *p)
+{
+	size_t size;
+	char *buf;
+	FILE *m;
+
+	m = open_memstream(&buf, &size);
+	if (!m) {
+		perror("open_memstream");
+		exit(EXIT_FAILURE);
+	}
+	print_production(m, cg, p);
+	fclose(m);
+
+	gen_comment(f, buf);
+	free(buf);
+}
+
+/* Write c as C constant */
+static void gen_char(FILE *f, unsigned char c)
+{
+	if (isalnum(c) || (ispunct(c) && c != '\'' && c != '\\'))
+		fprintf(f, "'%c'", c);
+	else
+		fprintf(f, "%u", c);
+}
+
+/* Write the condition that c is in the FIRST set of production i.  Small
+ * sets become comparisons, larger ones a bitmap.
+ */
+static void gen_first_set(FILE *f, unsigned int i, const struct charset *set)
+{
+	unsigned int c, count = 0;
+
+	for (c = 0; c < NUM_TERMINALS; c++)
+		count += charset_has(set, c) ? 1 : 0;
+
+	if (count > 3) {
+		fprintf(f, "first_%u[c >> 3] & 1 << (c & 7)", i);
+		return;
+	}
+
+	for (c = 0; c < NUM_TERMINALS; c++) {
+		if (!charset_has(set, c))
+			continue;
+		fprintf(f, "c == ");
+		gen_char(f, c);
+		if (--count)
+			fprintf(f, " || ");
+	}
+}
+
+static void gen_first_bitmaps(FILE *f, const struct compiled_grammar *cg,
+			      const struct nonterminal *nterm)
+{
+	const struct production *p;
+	unsigned int i, c, count;
+	unsigned char bits = 0;
+
+	for (i = nterm->first; i < nterm->first + nterm->count; i++) {
+		p = &cg->productions[i];
+		for (count = 0, c = 0; c < NUM_TERMINALS; c++)
+			count += charset_has(&p->first_set, c) ? 1 : 0;
+		if (!p->yield || p->yield == YIELD_INFINITE || count <= 3)
+			continue;
+
+		fprintf(f, "static const unsigned char first_%u[32] = {", i);
+		for (c = 0; c < NUM_TERMINALS; c++) {
+			if (c % 8 == 0) {
+				bits = 0;
+				fprintf(f, "%s", c % 64 ? " " : "\n\t");
+			}
+			if (charset_has(&p->first_set, c))
+				bits |= 1 << (c % 8);
+			if (c % 8 == 7)
+				fprintf(f, "0x%02x,", bits);
+		}
+		fprintf(f, "\n};\n\n");
+	}
+}
+
+static void gen_nonterminal(FILE *f, const struct compiled_grammar *cg,
+			    unsigned int index)
+{
+	const struct nonterminal *nterm = &cg->nonterm[index];
+	bool applies = false, first = false, prefix = false, push = false;
+	const struct production *p;
+	unsigned int i, j, alt, rest;
+
+	gen_first_bitmaps(f, cg, nterm);
+
+	/* Only declare what the productions use */
+	for (i = nterm->first; i < nterm->first + nterm->count; i++) {
+		p = &cg->productions[i];
+		if (p->yield == YIELD_INFINITE)
+			continue;
+		applies = true;
+		first |= p->yield > 0;
+		prefix |= p->prefix > 0;
+		push |= p->len > p->prefix;
+	}
+
+	fprintf(f, "/* ");
+	gen_comment(f, cg->names + nterm->name);
+	fprintf(f, " */\n"
+		   "static bool expand_%u(struct state *st, struct frame *f)\n"
+		   "{\n", index);
+	if (first || prefix)
+		fprintf(f, "\tconst unsigned char *w = st->word + f->pos;\n");
+	if (applies)
+		fprintf(f, "\tconst size_t rest = st->len - f->pos;\n");
+	if (first)
+		fprintf(f, "\tconst unsigned int c = rest ? w[0] : 0;\n");
+	if (applies)
+		fprintf(f, "\tconst unsigned int top = f->top - 1;\n"
+			   "\tconst size_t yield = f->yield - %uU;\n",
+			nterm->min_yield);
+	if (push)
+		fprintf(f, "\tsymbol_t *s;\n");
+	if (applies)
+		fprintf(f, "\n");
+	fprintf(f, "\tswitch (f->alt + 1) {\n");
+
+	for (alt = 0; alt < nterm->count; alt++) {
+		i = nterm->first + alt;
+		p = &cg->productions[i];
+		rest = p->len - p->prefix;
+
+		fprintf(f, "\tcase %u:\n"
+			   "\t\t/* ", alt);
+		gen_production(f, cg, p);
+		fprintf(f, " */\n");
+
+		/* Productions that derive no word at all never apply */
+		if (p->yield == YIELD_INFINITE) {
+			fprintf(f, "\t\t/* fall through */\n");
+			continue;
+		}
+
+		if (p->yield) {
+			fprintf(f, "\t\tif (!(");
+			gen_first_set(f, i, &p->first_set);
+			fprintf(f, "))\n"
+				   "\t\t\tgoto alt_%u;\n", alt + 1);
+		}
+		if (rest)
+			fprintf(f, "\t\tif (!reserve(st, top, %u)) {\n"
+				   "\t\t\tst->limited = true;\n"
+				   "\t\t\tgoto alt_%u;\n"
+				   "\t\t}\n", rest, alt + 1);
+		fprintf(f, "\t\tif (yield + %uU > rest", p->yield);
+		for (j = 0; j < p->prefix; j++) {
+			fprintf(f, " ||\n\t\t    w[%u] != ", j);
+			gen_char(f, cg->prefix_chars[p->prefix_offset + j]);
+		}
+		fprintf(f, ")\n"
+			   "\t\t\tgoto alt_%u;\n", alt + 1);
+
+		if (rest)
+			fprintf(f, "\t\ts = st->stack + top;\n");
+		for (j = 0; j < rest; j++) {
+			symbol_t symbol = cg->symbols[p->offset + j];
+
+			fprintf(f, "\t\ts[%u] = ", j);
+			if (is_nonterminal(symbol))
+				fprintf(f, "%u;\n", symbol);
+			else {
+				gen_char(f, symbol);
+				fprintf(f, ";\n");
+			}
+		}
+		fprintf(f, "\t\tst->top = top + %u;\n"
+			   "\t\tst->yield = yield + %uU;\n"
+			   "\t\tst->pos = f->pos + %u;\n"
+			   "\t\tf->alt = %u;\n"
+			   "\t\treturn true;\n"
+			   "alt_%u:\n", rest, p->yield - p->prefix, p->prefix,
+			alt, alt + 1);
+	}
+
+	fprintf(f, "\tdefault:\n"
+		   "\t\tbreak;\n"
+		   "\t}\n\n"
+		   "\tst->top = f->top;\n"
+		   "\treturn false;\n"
+		   "}\n\n");
+}
+
+static const char gen_header[] =
+	"#include <limits.h>\n"
+	"#include <stdbool.h>\n"
+	"#include <stddef.h>\n"
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"enum { NAY, YEP, LIMIT };\n"
+	"\n"
+	"typedef unsigned short symbol_t;\n"
+	"\n"
+	"#define FRAME_TERMINAL -2\n"
+	"#define FRAME_NONE UINT_MAX\n"
+	"\n"
+	"struct frame {\n"
+	"\tsize_t pos;\n"
+	"\tunsigned int top, yield, len, below;\n"
+	"\tint alt;\n"
+	"\tsymbol_t symbol;\n"
+	"};\n"
+	"\n"
+	"struct state {\n"
+	"\tconst unsigned char *word;\n"
+	"\tsize_t len, pos;\n"
+	"\tsymbol_t *stack;\n"
+	"\tunsigned int top, size, yield;\n"
+	"\tstruct frame *frames;\n"
+	"\tunsigned int count, frames_size;\n"
+	"\tbool limited;\n"
+	"};\n"
+	"\n"
+	"static inline bool reserve(struct state *st, unsigned int top,\n"
+	"\t\t\t   unsigned int len)\n"
+	"{\n"
+	"\tunsigned int needed = top + len, size = st->size;\n"
+	"\n"
+	"\tif (needed > MAX_DEPTH || needed < len)\n"
+	"\t\treturn false;\n"
+	"\tif (needed <= st->size)\n"
+	"\t\treturn true;\n"
+	"\n"
+	"\twhile (size < needed)\n"
+	"\t\tsize = size > UINT_MAX / 2 ? UINT_MAX : size * 2;\n"
+	"\tst->stack = realloc(st->stack, (size_t)size * sizeof(*st->stack));\n"
+	"\tif (!st->stack) {\n"
+	"\t\tperror(\"realloc\");\n"
+	"\t\texit(EXIT_FAILURE);\n"
+	"\t}\n"
+	"\tst->size = size;\n"
+	"\n"
+	"\treturn true;\n"
+	"}\n"
+	"\n"
+	"static struct frame *push_frame(struct state *st)\n"
+	"{\n"
+	"\tif (st->count == st->frames_size) {\n"
+	"\t\tst->frames_size = st->frames_size ? st->frames_size * 2 : 64;\n"
+	"\t\tst->frames = realloc(st->frames,\n"
+	"\t\t\t\t     st->frames_size * sizeof(*st->frames));\n"
+	"\t\tif (!st->frames) {\n"
+	"\t\t\tperror(\"realloc\");\n"
+	"\t\t\texit(EXIT_FAILURE);\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\treturn &st->frames[st->count++];\n"
+	"}\n"
+	"\n"
+	"static unsigned int frame_below(const struct state *st)\n"
+	"{\n"
+	"\tunsigned int i = st->count ? st->count - 1 : FRAME_NONE;\n"
+	"\tconst struct frame *f;\n"
+	"\n"
+	"\twhile (i != FRAME_NONE) {\n"
+	"\t\tf = &st->frames[i];\n"
+	"\t\tif (f->pos != st->pos || f->alt == FRAME_TERMINAL)\n"
+	"\t\t\treturn FRAME_NONE;\n"
+	"\t\tif (f->top <= st->top)\n"
+	"\t\t\treturn i;\n"
+	"\t\ti = f->below;\n"
+	"\t}\n"
+	"\n"
+	"\treturn FRAME_NONE;\n"
+	"}\n"
+	"\n";
+
+static const char gen_repeats[] =
+	"\t\tbreak;\n"
+	"\tdefault:\n"
+	"\t\treturn false;\n"
+	"\t}\n"
+	"\n"
+	"\twhile (below != FRAME_NONE) {\n"
+	"\t\tf = &st->frames[below];\n"
+	"\t\tif (f->top != st->top)\n"
+	"\t\t\treturn false;\n"
+	"\t\tif (f->symbol == sym)\n"
+	"\t\t\treturn true;\n"
+	"\t\tbelow = f->below;\n"
+	"\t}\n"
+	"\n"
+	"\treturn false;\n"
+	"}\n"
+	"\n";
+
+static const char gen_driver[] =
+	"static int run(struct state *st)\n"
+	"{\n"
+	"\tstruct frame *f;\n"
+	"\tunsigned int len, below;\n"
+	"\tsymbol_t sym;\n"
+	"\n"
+	"\tst->count = 0;\n"
+	"\tfor (;;) {\n"
+	"\t\tif (!st->top) {\n"
+	"\t\t\tif (st->pos == st->len)\n"
+	"\t\t\t\treturn YEP;\n"
+	"\t\t\tgoto backtrack;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tsym = st->stack[st->top - 1];\n"
+	"\t\tif (sym >= 256) {\n"
+	"\t\t\tbelow = frame_below(st);\n"
+	"\t\t\tif (repeats(st, below, sym))\n"
+	"\t\t\t\tgoto backtrack;\n"
+	"\t\t\tf = push_frame(st);\n"
+	"\t\t\tf->below = below;\n"
+	"\t\t\tf->pos = st->pos;\n"
+	"\t\t\tf->top = st->top;\n"
+	"\t\t\tf->yield = st->yield;\n"
+	"\t\t\tf->symbol = sym;\n"
+	"\t\t\tf->alt = -1;\n"
+	"\t\t\tif (expand(st, f))\n"
+	"\t\t\t\tcontinue;\n"
+	"\t\t\tst->count--;\n"
+	"\t\t\tgoto backtrack;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tfor (len = 0; len < st->top; len++) {\n"
+	"\t\t\tsym = st->stack[st->top - 1 - len];\n"
+	"\t\t\tif (sym >= 256)\n"
+	"\t\t\t\tbreak;\n"
+	"\t\t\tif (st->pos + len == st->len ||\n"
+	"\t\t\t    st->word[st->pos + len] != sym)\n"
+	"\t\t\t\tgoto backtrack;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tf = push_frame(st);\n"
+	"\t\tf->pos = st->pos;\n"
+	"\t\tf->top = st->top;\n"
+	"\t\tf->yield = st->yield;\n"
+	"\t\tf->alt = FRAME_TERMINAL;\n"
+	"\t\tf->len = len;\n"
+	"\t\tst->top -= len;\n"
+	"\t\tst->yield -= len;\n"
+	"\t\tst->pos += len;\n"
+	"\t\tcontinue;\n"
+	"\n"
+	"backtrack:\n"
+	"\t\tfor (;;) {\n"
+	"\t\t\tif (!st->count)\n"
+	"\t\t\t\treturn st->limited ? LIMIT : NAY;\n"
+	"\n"
+	"\t\t\tf = &st->frames[st->count - 1];\n"
+	"\t\t\tst->top = f->top;\n"
+	"\t\t\tst->yield = f->yield;\n"
+	"\t\t\tst->pos = f->pos;\n"
+	"\t\t\tif (f->alt != FRAME_TERMINAL) {\n"
+	"\t\t\t\tst->stack[f->top - 1] = f->symbol;\n"
+	"\t\t\t\tif (expand(st, f))\n"
+	"\t\t\t\t\tbreak;\n"
+	"\t\t\t} else {\n"
+	"\t\t\t\tfor (len = 0; len < f->len; len++)\n"
+	"\t\t\t\t\tst->stack[f->top - 1 - len] =\n"
+	"\t\t\t\t\t\tst->word[f->pos + len];\n"
+	"\t\t\t}\n"
+	"\t\t\tst->count--;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"}\n"
+	"\n";
+
+static const char gen_main[] =
+	"#ifndef PDA_GEN_NO_MAIN\n"
+	"int main(int argc, char **argv)\n"
+	"{\n"
+	"\tstatic const char *const verdicts[] = { \"Nay\", \"Yep\", \"Limit\" };\n"
+	"\tFILE *stream = stdin;\n"
+	"\tchar *line = NULL;\n"
+	"\tsize_t size = 0;\n"
+	"\tssize_t len;\n"
+	"\tint ret = EXIT_SUCCESS, verdict;\n"
+	"\n"
+	"\tif (argc > 1 && strcmp(argv[1], \"-\")) {\n"
+	"\t\tstream = fopen(argv[1], \"r\");\n"
+	"\t\tif (!stream) {\n"
+	"\t\t\tperror(argv[1]);\n"
+	"\t\t\treturn EXIT_FAILURE;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\twhile ((len = getline(&line, &size, stream)) != -1) {\n"
+	"\t\tif (len && line[len - 1] == '\\n')\n"
+	"\t\t\tline[--len] = '\\0';\n"
+	"\t\tverdict = pda_generated_recognize(line, len);\n"
+	"\t\tputs(verdicts[verdict]);\n"
+	"\t\tif (verdict != YEP)\n"
+	"\t\t\tret = EXIT_FAILURE;\n"
+	"\t}\n"
+	"\tfree(line);\n"
+	"\n"
+	"\treturn ret;\n"
+	"}\n"
+	"#endif\n";
+
+/* Write a recognizer specialized to the grammar of pda to the file name */
+static bool generate_recognizer(const struct pda *pda, const char *name)
+{
+	const struct compiled_grammar *cg = pda->g;
+	const unsigned int start_yield = symbol_yield(cg, pda->start);
+	unsigned int i, cyclic;
+	FILE *f;
+
+	f = fopen(name, "w");
+	if (!f) {
+		perror(name);
+		return false;
+	}
+
+	fprintf(f, "/*\n"
+		   " * A recognizer specialized to a grammar, generated by "
+		   "PDA.  Don't edit.\n"
+		   " *\n");
+	for (i = 0; i < cg->num_productions; i++) {
+		fprintf(f, " *   ");
+		gen_production(f, cg, &cg->productions[i]);
+		fprintf(f, "\n");
+	}
+	fprintf(f, " */\n\n"
+		   "#define _GNU_SOURCE\n"
+		   "#define MAX_DEPTH %uU\n"
+		   "#define STACK_INITIAL %u\n\n", pda->max_depth,
+		STACK_INLINE_SIZE);
+	fputs(gen_header, f);
+
+	for (i = 0; i < cg->num_nonterms; i++)
+		gen_nonterminal(f, cg, i);
+
+	fprintf(f, "static bool expand(struct state *st, struct frame *f)\n"
+		   "{\n"
+		   "\tswitch (f->symbol) {\n");
+	for (i = 0; i < cg->num_nonterms; i++)
+		fprintf(f, "\tcase %u:\n"
+			   "\t\treturn expand_%u(st, f);\n", NONTERMINAL(i), i);
+	fprintf(f, "\tdefault:\n"
+		   "\t\treturn false;\n"
+		   "\t}\n"
+		   "}\n\n");
+
+	/* Only the nonterminals that can go in a circle need to check for it */
+	for (i = 0, cyclic = 0; i < cg->num_nonterms; i++)
+		cyclic += cg->nonterm[i].cyclic;
+	fprintf(f, "static bool repeats(const struct state *st, unsigned int below,\n"
+		   "\t\t    symbol_t sym)\n"
+		   "{\n");
+	if (cyclic) {
+		fprintf(f, "\tconst struct frame *f;\n"
+			   "\n"
+			   "\tswitch (sym) {\n");
+		for (i = 0; i < cg->num_nonterms; i++)
+			if (cg->nonterm[i].cyclic)
+				fprintf(f, "\tcase %u:\n", NONTERMINAL(i));
+		fputs(gen_repeats, f);
+	} else
+		fprintf(f, "\t(void)st;\n"
+			   "\t(void)below;\n"
+			   "\t(void)sym;\n"
+			   "\treturn false;\n"
+			   "}\n\n");
+	fputs(gen_driver, f);
+
+	fprintf(f, "int pda_generated_recognize(const char *word, size_t len)\n"
+		   "{\n"
+		   "\tstatic _Thread_local struct state st;\n"
+		   "\n"
+		   "\tif (!st.size) {\n"
+		   "\t\tst.size = STACK_INITIAL;\n"
+		   "\t\tst.stack = malloc(st.size * sizeof(*st.stack));\n"
+		   "\t\tif (!st.stack) {\n"
+		   "\t\t\tperror(\"malloc\");\n"
+		   "\t\t\texit(EXIT_FAILURE);\n"
+		   "\t\t}\n"
+		   "\t}\n"
+		   "\n"
+		   "\tst.word = (const unsigned char *)word;\n"
+		   "\tst.len = len;\n"
+		   "\tst.pos = 0;\n"
+		   "\tst.stack[0] = %u;\n"
+		   "\tst.top = 1;\n"
+		   "\tst.yield = %uU;\n"
+		   "\tst.limited = false;\n"
+		   "\n"
+		   "\treturn run(&st);\n", pda->start, start_yield);
+	fprintf(f, "}\n\n");
+	fputs(gen_main, f);
+
+	if (fclose(f)) {
+		perror(name);
+		return false;
+	}
+
+	return true;
+}
+
+static const char *const engine_names[NUM_ENGINES] = {
+	[ENGINE_BACKTRACK] = "backtrack",
+	[ENGINE_LL1] = "ll1",
+	[ENGINE_EARLEY] = "earley",
+	[ENGINE_CYK] = "cyk",
+	[ENGINE_SLR] = "slr",
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-bdmnNqt] [-B trace] [-e engine] [-g grammar] "
+			"[-j jobs] [-L depth]\n"
+			"          [-s format] [budget] word\n"
+			"       %s [-bdmnNqt] [-B trace] [-e engine] [-g grammar] "
+			"[-j jobs]\n"
+			"          [-s format] [budget] -i file\n"
+			"       %s [-bdmnNqrt] [-B trace] [-e engine] [-g grammar] "
+			"[-j jobs]\n"
+			"          [-s format] [budget] -f file\n"
+			"       %s [-bmnN] [-e engine] [-g grammar] [-j jobs] "
+			"[-s format] [budget]\n"
+			"          -l socket\n"
+			"       %s [-nN] [-g grammar] -c cache\n"
+			"       %s [-nN] [-g grammar] [-L depth] -G file\n"
+			"  -B  write a binary trace of every step to trace instead "
+			"of the text trace,\n"
+			"      trace.py decodes it (backtrack, ll1 and slr "
+			"engines)\n"
+			"  -b  print timing, peak stack depth and memory on stderr\n"
+			"  -c  write the compiled grammar to cache\n"
+			"  -D  deepen iteratively, starting with a stack of depth "
+			"symbols\n"
+			"  -d  print the leftmost derivation of accepted words\n"
+			"  -e  engine: backtrack (default), ll1, earley, cyk or "
+			"slr\n"
+			"  -f  check every line of file ('-' for stdin)\n"
+			"  -G  write a recognizer specialized to the grammar as C "
+			"source to file\n"
+			"  -g  load the grammar from a text file or cache\n"
+			"  -i  check the content of file ('-' for stdin)\n"
+			"  -j  number of threads, implies -q: for -f, they check "
+			"different lines, for\n"
+			"      a single word, they share the search of the "
+			"backtracker\n"
+			"  -L  maximal depth of the stack\n"
+			"  -l  answer requests '<id> <length>\\n<word>' with "
+			"'<id> <verdict>\\n' on a\n"
+			"      Unix socket ('-' for stdin and stdout), with jobs "
+			"workers\n"
+			"  -m  memoize failed configurations\n"
+			"  -n  normalize the grammar: remove useless nonterminals "
+			"and unit productions\n"
+			"  -N  like -n, and inline nonterminals that are used "
+			"once\n"
+			"  -q  quiet, only print the verdict\n"
+			"  -r  every line of file is an edit of the line before, "
+			"only check what\n"
+			"      changed (earley engine)\n"
+			"  -S  give up on a word after steps steps of the "
+			"engine\n"
+			"  -s  print statistics of the backtracker on stderr, "
+			"as text or json\n"
+			"  -T  give up on a word after ms milliseconds of the "
+			"engine\n"
+			"  -t  print the parse tree of accepted words\n"
+			"  budget is any of -D depth, -S steps and -T ms, words "
+			"that run out of it\n"
+			"  are Undecided\n",
+		prog, prog, prog, prog, prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct pda_grammar *grammar = pda_grammar_new();
+	struct compiled_grammar *cg = &grammar->cg;
+	struct pda *pda = &grammar->pda;
+	struct compiled_grammar before;
+	struct scratch *scratch;
+	const char *batch = NULL, *grammar_file = NULL, *cache = NULL;
+	const char *input_file = NULL, *generate = NULL;
+	const char *trace_file = NULL, *serve = NULL;
+	struct input input;
+	unsigned int jobs = 1;
+	FILE *stream = NULL;
+	enum verdict verdict = VERDICT_NAY;
+	unsigned long long start;
+	bool ret = false, bench = false, normalize = false;
+	bool inline_nonterms = false;
+	unsigned long depth;
+	char *end;
+	int opt;
+
+	pda->engine = ENGINE_BACKTRACK;
+	pda->trace = true;
+
+	while ((opt = getopt(argc, argv, "B:bc:D:de:f:G:g:i:j:L:l:mnNqrS:s:T:t")) != -1) {
+		switch (opt) {
+		case 'B':
+			trace_file = optarg;
+			pda->trace = false;
+			if (!PDA_TRACE)
+				fprintf(stderr, "Traces are compiled out\n");
+			break;
+		case 'b':
+			bench = true;
+			break;
+		case 'c':
+			cache = optarg;
+			break;
+		case 'D':
+			pda->deepen = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			pda->derivation = DERIVATION_LIST;
+			break;
+		case 'e':
+			for (pda->engine = 0; pda->engine < NUM_ENGINES;
+			     pda->engine++)
+				if (!strcmp(optarg, engine_names[pda->engine]))
+					break;
+			if (pda->engine == NUM_ENGINES) {
+				fprintf(stderr, "Unknown engine: %s\n",
+					optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'f':
+			batch = optarg;
+			break;
+		case 'G':
+			generate = optarg;
+			break;
+		case 'g':
+			grammar_file = optarg;
+			break;
+		case 'i':
+			input_file = optarg;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1) {
+				usage(argv[0]);
+				return -1;
+			}
+			/* The traces of all threads would mix up */
+			pda->trace = false;
+			break;
+		case 'L':
+			errno = 0;
+			depth = strtoul(optarg, &end, 0);
+			if (errno || end == optarg || *end || !depth ||
+			    depth > UINT_MAX) {
+				fprintf(stderr, "Invalid depth: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			pda->max_depth = depth;
+			break;
+		case 'l':
+			serve = optarg;
+			/* The answers are all that goes to stdout */
+			pda->trace = false;
+			break;
+		case 'm':
+			pda->memoize = true;
+			break;
+		case 'n':
+			normalize = true;
+			break;
+		case 'N':
+			normalize = inline_nonterms = true;
+			break;
+		case 'q':
+			pda->trace = false;
+			break;
+		case 'r':
+			pda->incremental = true;
+			break;
+		case 'S':
+			pda->max_steps = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			if (!strcmp(optarg, "text")) {
+				pda->stats = STATS_TEXT;
+			} else if (!strcmp(optarg, "json")) {
+				pda->stats = STATS_JSON;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+			if (!PDA_STATS)
+				fprintf(stderr, "Statistics are compiled "
+						"out\n");
+			break;
+		case 'T':
+			pda->timeout = strtoull(optarg, NULL, 0) * 1000000ULL;
+			break;
+		case 't':
+			pda->derivation = DERIVATION_TREE;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	/* Check if we do have a single word left after the options, or none
+	 * if the word comes from a file.  optind is the index of the first
+	 * non-option argument in argv.  When writing a cache or a
+	 * recognizer, the word is optional.
+	 */
+	if ((batch && input_file) || (serve && (batch || input_file)) ||
+	    (argc - optind != (batch || input_file || serve ? 0 : 1) &&
+	     !((cache || generate) && !batch && !input_file &&
+	       argc == optind))) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	/* Only the frames of the backtracker and of the LL(1) parser tell
+	 * how a word was derived, and the workers of -j don't keep them.
+	 */
+	if (pda->derivation && (pda->engine == ENGINE_EARLEY ||
+			       pda->engine == ENGINE_CYK ||
+			       pda->engine == ENGINE_SLR || jobs > 1 || serve)) {
+		fprintf(stderr, "Derivations need the backtrack or ll1 engine, "
+				"and don't work with -j or -l\n");
+		return -1;
+	}
+
+	if (pda->incremental &&
+	    (pda->engine != ENGINE_EARLEY || !batch || jobs > 1)) {
+		fprintf(stderr, "Incremental checks need the earley engine and "
+				"-f, and don't work with -j\n");
+		return -1;
+	}
+
+	/* Only the engines with a stack record traces, and the records of
+	 * several threads would mix up
+	 */
+	if (trace_file && (pda->engine == ENGINE_EARLEY ||
+			   pda->engine == ENGINE_CYK || jobs > 1 || serve)) {
+		fprintf(stderr, "Binary traces need the backtrack, ll1 or slr "
+				"engine, and don't work with -j or -l\n");
+		return -1;
+	}
+
+	/* A single word keeps all threads busy with its own search */
+	if (!batch && !serve && jobs > 1)
+		pda->parallel = jobs;
+
+	if (batch) {
+		stream = strcmp(batch, "-") ? fopen(batch, "r") : stdin;
+		if (!stream) {
+			perror(batch);
+			return -1;
+		}
+	}
+
+	if (grammar_file) {
+		if (!load_grammar(grammar_file, cg, &pda->start))
+			return -1;
+	} else {
+		compile_grammar(wtf, cg, &pda->start);
+	}
+
+	setup_grammar(grammar, normalize, inline_nonterms, &before);
+	if (normalize) {
+		if (pda->trace)
+			print_normalization(&before, cg);
+		free_grammar(&before);
+	}
+
+	if (cache && !save_grammar_cache(cache, cg, pda->start))
+		return -1;
+	if (generate && !generate_recognizer(pda, generate))
+		return -1;
+	if ((cache || generate) && !batch && !input_file && argc == optind) {
+		pda_free(grammar);
+		return EXIT_SUCCESS;
+	}
+
+	if (pda->trace)
+		dump_grammar(cg);
+
+	/* The engines that need a table fall back to backtracking if the
+	 * grammar doesn't permit one
+	 */
+	if (pda->engine == ENGINE_LL1 && !pda->ll1)
+		fprintf(stderr, "Grammar is not LL(1), falling back to "
+				"backtracking\n");
+	if (pda->engine == ENGINE_CYK && !pda->cyk)
+		fprintf(stderr, "Falling back to backtracking\n");
+	if (pda->engine == ENGINE_SLR && !pda->lr)
+		fprintf(stderr, "Grammar is not SLR(1), falling back to "
+				"backtracking\n");
+
+	/* The records name the productions of the engine's grammar, which
+	 * is only known once the engine is set up
+	 */
+	if (PDA_TRACE && trace_file) {
+		pda->trace_file = fopen(trace_file, "wb");
+		if (!pda->trace_file ||
+		    !write_trace_header(pda->trace_file, engine_grammar(pda))) {
+			perror(trace_file);
+			return -1;
+		}
+	}
+
+	scratch = scratch_new(pda);
+	start = now_ns();
+
+	if (serve) {
+		ret = run_server(pda, scratch, jobs, serve);
+	} else if (stream) {
+		if (jobs > 1)
+			ret = run_batch_threaded(pda, scratch, jobs, stream);
+		else
+			ret = run_batch(pda, scratch, stream);
+		if (stream != stdin)
+			fclose(stream);
+	} else if (input_file) {
+		if (!open_input(input_file, &input))
+			return -1;
+		verdict = recognize(pda, scratch, input.data, input.len);
+		close_input(&input);
+	} else {
+		verdict = recognize(pda, scratch, argv[optind],
+				    strlen(argv[optind]));
+	}
+
+	if (bench)
+		print_bench(scratch, now_ns() - start);
+	if (PDA_STATS && pda->stats)
+		print_stats(pda, &scratch->stats, pda->stats);
+
+	if (!stream && !serve) {
+		print_verdict(pda, scratch, verdict);
+		ret = verdict == VERDICT_YEP;
+	}
+
+	if (pda->trace_file) {
+		trace_flush(pda, scratch);
+		if (fclose(pda->trace_file)) {
+			perror(trace_file);
+			ret = false;
+		}
+	}
+
+	scratch_free(scratch);
+	pda_free(grammar);
+
+	/* A word that we couldn't decide exits with 2 */
+	if (!stream && !serve && (verdict == VERDICT_LIMIT ||
+			verdict == VERDICT_UNDECIDED))
+		return 2;
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* PDA_LIBRARY */
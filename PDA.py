@@ -33,9 +33,12 @@ P = { 'S': {'AB'},
 # PDA doesn't need a state if we want our PDA to decide a cf grammar.
 #
 # So the automata only takes a word and the content of the stack, and returns
-# either True or False, iow word is element of the language or not.
-def run_pda(word, stack):
-    print('%s %s' % (word, stack))
+# either True or False, iow word is element of the language or not.  By
+# default, it decides the grammar above and prints every configuration, but
+# other grammars, e.g., those of difftest.py, may be passed as rules.
+def run_pda(word, stack, rules=P, trace=True):
+    if trace:
+        print('%s %s' % (word, stack))
 
     # if the stack is empty then we have two cases:
     #  - word is empty     -> Yay, we can accept the word, as this is the
@@ -57,8 +60,8 @@ def run_pda(word, stack):
     # If we hit a nonterminal symbol, try to apply every available
     # production rule for the symbol, and recursively run the PDA again.
     if top_stack.isupper():
-        for production in P[top_stack]:
-            if run_pda(word, production + stack):
+        for production in rules[top_stack]:
+            if run_pda(word, production + stack, rules, trace):
                 return True
         # Dead end, no rule was successful.
         return False
@@ -77,14 +80,15 @@ def run_pda(word, stack):
     # stack? If yes, consume it and run the PDA on the rest of the word and the
     # new stack. If not, dead end.
     if (top_word == top_stack):
-        return run_pda(word, stack)
+        return run_pda(word, stack, rules, trace)
 
     return False
 
 
 # And here we start our PDA with some input word, the initial content of the
-# stack is our start symbol S.
-print(run_pda('aabbbccc', 'S'))
+# stack is our start symbol S.  Unless we're imported as a module.
+if __name__ == '__main__':
+    print(run_pda('aabbbccc', 'S'))
 
 # Let's go a bit further, and check if the word a^100 b^23 c^23 is element
 # of the grammar... Play around with the length of the words, your stack will
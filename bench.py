@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+
+# Benchmark driver for PDA
+#
+# Copyright (c) Ralf Ramsauer, 2017
+#
+# Authors:
+#  Ralf Ramsauer <ralf.ramsauer@oth-regensburg.de>
+#
+# This work is licensed under the terms of the GNU GPL, version 2. See the
+# COPYING file in the top-level directory.
+
+# We generate families of words for the bundled grammars.  Every family is
+# parameterized by n and either accepted or rejected.  The rejected ones are
+# near misses: they only differ in a single char from an accepted word, so
+# the engines have to work through (almost) the whole word until they fail.
+#
+# For every family, n and engine, we write a batch of words to a file and let
+# PDA check it with -b, which reports the rates, the peak depth of the stack
+# and the peak memory.  The timing is done by PDA itself, so the startup of
+# the process doesn't count.  Every run is repeated, and only the fastest one
+# counts, which filters out most of the noise of a busy machine.
+#
+# The results can be saved as baseline, later runs compare against it and
+# report every regression.
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+# Families: name -> (grammar file or None for the built-in one, expected
+# verdict, generator)
+FAMILIES = {
+    # a^n b^m c^m, the built-in grammar
+    'abc':          (None, 'Yep', lambda n: 'a' * n + 'b' * n + 'c' * n),
+    'abc-short-c':  (None, 'Nay', lambda n: 'a' * n + 'b' * n + 'c' * (n - 1)),
+    'abc-extra-b':  (None, 'Nay', lambda n: 'a' * n + 'b' * (n + 1) + 'c' * n),
+    'abc-no-a':     (None, 'Nay', lambda n: 'b' * n + 'c' * n),
+    'abc-swapped':  (None, 'Nay', lambda n: 'a' * n + 'b' * (n - 1) + 'cb' +
+                                            'c' * (n - 1)),
+
+    # Arithmetic expressions
+    'expr-nested':  ('grammars/expr.txt', 'Yep',
+                     lambda n: '(' * n + 'x' + ')' * n),
+    'expr-open':    ('grammars/expr.txt', 'Nay',
+                     lambda n: '(' * n + 'x' + ')' * (n - 1)),
+    'expr-sum':     ('grammars/expr.txt', 'Yep',
+                     lambda n: '+'.join(['x'] * n)),
+    'expr-dangling': ('grammars/expr.txt', 'Nay',
+                      lambda n: '+'.join(['x'] * n) + '+'),
+}
+
+ENGINES = {
+    'backtrack':    ['-e', 'backtrack'],
+    'memo':         ['-e', 'backtrack', '-m'],
+    'll1':          ['-e', 'll1'],
+    'earley':       ['-e', 'earley'],
+    'cyk':          ['-e', 'cyk'],
+    'slr':          ['-e', 'slr'],
+}
+
+# CYK takes cubic time on every word, so it would only time out on the larger
+# n.  It has to be asked for explicitly.
+DEFAULT_ENGINES = ['backtrack', 'memo', 'll1', 'slr', 'earley']
+
+def run_once(pda, family, n, engine, chars, timeout):
+    grammar, expected, generate = FAMILIES[family]
+    word = generate(n)
+    words = max(1, chars // max(1, len(word)))
+
+    args = [pda, '-q', '-b'] + ENGINES[engine]
+    if grammar:
+        args += ['-g', grammar]
+
+    with tempfile.NamedTemporaryFile('w', suffix='.txt') as batch:
+        batch.write((word + '\n') * words)
+        batch.flush()
+        try:
+            p = subprocess.run(args + ['-f', batch.name],
+                               capture_output=True, text=True,
+                               timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return None
+
+    verdicts = set(p.stdout.split())
+    if verdicts != {expected}:
+        sys.exit('%s n=%u %s: expected %s, got %s' %
+                 (family, n, engine, expected, ' '.join(sorted(verdicts))))
+
+    for line in p.stderr.splitlines():
+        if line.startswith('bench: '):
+            return dict(field.split('=') for field in line[7:].split())
+
+    sys.exit('%s n=%u %s: no figures from PDA: %s' %
+             (family, n, engine, p.stderr.strip()))
+
+def run(pda, family, n, engine, chars, timeout, repeat):
+    best = None
+    for i in range(repeat):
+        figures = run_once(pda, family, n, engine, chars, timeout)
+        if not figures:
+            return None
+        if not best or float(figures['ns/char']) < float(best['ns/char']):
+            best = figures
+
+    return best
+
+def load_baseline(name):
+    baseline = {}
+    if not os.path.exists(name):
+        return baseline
+
+    with open(name) as f:
+        for line in f:
+            if line.startswith('#') or not line.strip():
+                continue
+            family, n, engine, ns_per_char = line.split()
+            baseline[(family, int(n), engine)] = float(ns_per_char)
+
+    return baseline
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the PDA engines')
+    parser.add_argument('--pda', default='./PDA', help='PDA binary')
+    parser.add_argument('-n', default='16,64,256,1024,4096',
+                        help='comma separated sweep of n')
+    parser.add_argument('--families', default=','.join(FAMILIES),
+                        help='comma separated families')
+    parser.add_argument('--engines', default=','.join(DEFAULT_ENGINES),
+                        help='comma separated engines')
+    parser.add_argument('--chars', type=int, default=1 << 18,
+                        help='approximate number of chars per run')
+    parser.add_argument('--timeout', type=float, default=20,
+                        help='seconds until a run is given up')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='number of runs, the fastest one counts')
+    parser.add_argument('--tolerance', type=float, default=1.25,
+                        help='slowdowns up to this factor are noise')
+    parser.add_argument('--baseline', help='compare against this baseline')
+    parser.add_argument('--save', help='save the results as baseline')
+    args = parser.parse_args()
+
+    baseline = load_baseline(args.baseline) if args.baseline else {}
+    if args.baseline and not baseline:
+        print('# no baseline in %s, run make bench-baseline first' %
+              args.baseline)
+
+    results = []
+    regressions = 0
+    print('%-14s %6s %-10s %12s %10s %8s %10s %s' %
+          ('family', 'n', 'engine', 'words/s', 'ns/char', 'depth', 'memory',
+           'baseline'))
+    for family in args.families.split(','):
+        for n in map(int, args.n.split(',')):
+            for engine in args.engines.split(','):
+                figures = run(args.pda, family, n, engine, args.chars,
+                              args.timeout, args.repeat)
+                if not figures:
+                    # A run that used to finish and now times out is the
+                    # worst regression of all
+                    compare = ''
+                    if (family, n, engine) in baseline:
+                        compare = 'REGRESSION'
+                        regressions += 1
+                    print('%-14s %6u %-10s %12s %10s %8s %10s %s' %
+                          (family, n, engine, 'timeout', '', '', '',
+                           compare))
+                    sys.stdout.flush()
+                    continue
+
+                ns_per_char = float(figures['ns/char'])
+                results.append((family, n, engine, ns_per_char))
+
+                compare = ''
+                old = baseline.get((family, n, engine))
+                if old:
+                    ratio = ns_per_char / old
+                    compare = '%.2fx' % ratio
+                    if ratio > args.tolerance:
+                        compare += ' REGRESSION'
+                        regressions += 1
+
+                print('%-14s %6u %-10s %12s %10.2f %8s %10s %s' %
+                      (family, n, engine, figures['words/s'], ns_per_char,
+                       figures['depth'], figures['rss'], compare))
+                sys.stdout.flush()
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            f.write('# family n engine ns/char\n')
+            for result in results:
+                f.write('%s %u %s %.3f\n' % result)
+
+    if regressions:
+        sys.exit('%u regressions' % regressions)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,441 @@
+#!/usr/bin/env python3
+
+# Differential test of the PDA engines
+#
+# Copyright (c) Ralf Ramsauer, 2017
+#
+# Authors:
+#  Ralf Ramsauer <ralf.ramsauer@oth-regensburg.de>
+#
+# This work is licensed under the terms of the GNU GPL, version 2. See the
+# COPYING file in the top-level directory.
+
+# We generate random grammars, and for every grammar a batch of words: random
+# ones, sentences of random derivations, and near misses of the sentences.
+# Every engine checks the batch, and all engines that come to a verdict must
+# agree on it.  Limit and Undecided are no verdicts, the backtracker may
+# legitimately run out of depth or budget.  The engines that can't handle a
+# grammar fall back to backtracking, which still has to agree.
+#
+# Most engines check the whole batch with -f, the search engine gets every word
+# on the command line, so the threads share the search of a single word.  The
+# library engines load libpda.so and call pda_recognize() and
+# pda_recognize_edit() on every word.
+#
+# On top of the engines of PDA itself, every few grammars are compiled with -G
+# into a recognizer of their own, and PDA.py, the reference implementation,
+# decides the short words.  It searches naively, so it may recurse forever on
+# left recursive grammars, which counts as no verdict, too.
+#
+# Every engine is timed, by PDA itself with -b, or by the wall clock for the
+# compiled recognizers and PDA.py.  In the end, we print the time per word of
+# every engine, and its worst grammar, so performance cliffs stand out.  The
+# worst grammar i can be rerun with --seed i --grammars 1.
+
+import argparse
+import ctypes
+import os
+import random
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+import PDA as oracle
+
+ENGINES = {
+    'backtrack':    ['-e', 'backtrack'],
+    'memo':         ['-e', 'backtrack', '-m'],
+    'deepen':       ['-e', 'backtrack', '-D', '4'],
+    'normalized':   ['-e', 'backtrack', '-N'],
+    'threads':      ['-e', 'backtrack', '-j', '2'],
+    'search':       ['-e', 'backtrack', '-j', '2'],
+    'server':       ['-e', 'backtrack', '-j', '2', '-l', '-'],
+    'll1':          ['-e', 'll1'],
+    'slr':          ['-e', 'slr'],
+    'earley':       ['-e', 'earley'],
+    'incremental':  ['-e', 'earley', '-r'],
+    'cyk':          ['-e', 'cyk'],
+}
+
+# The engines of libpda: name -> (enum pda_engine, whether every word is
+# recognized as an edit of the word before)
+LIBRARY = {
+    'library':      (0, False),
+    'library-edit': (2, True),
+}
+
+VERDICTS = {'Yep', 'Nay'}
+
+# The backtracker gives up on a word after that many steps
+STEPS = 1 << 20
+
+def random_grammar(rng):
+    nonterms = 'SABCD'[:rng.randint(1, 5)]
+    terminals = 'abc'[:rng.randint(1, 3)]
+    symbols = terminals * 2 + nonterms
+
+    rules = {}
+    for nonterm in nonterms:
+        alts = set()
+        count = rng.randint(1, 4)
+        # Alternatives that start with different terminals make grammars
+        # that the deterministic engines can handle more likely
+        firsts = rng.sample(terminals, min(count, len(terminals))) \
+                 if rng.random() < 0.3 else []
+        for i in range(count):
+            alt = ''.join(rng.choice(symbols)
+                          for _ in range(rng.randint(0, 4)))
+            if i < len(firsts) and alt:
+                alt = firsts[i] + alt[1:]
+            alts.add(alt)
+        rules[nonterm] = sorted(alts)
+
+    return rules
+
+def grammar_text(rules):
+    return ''.join('%s -> %s\n' % (nonterm, ' | '.join(alts))
+                   for nonterm, alts in rules.items())
+
+# The minimal yield of every nonterminal, and the alternative that yields it.
+# The symbols of that alternative got their minimal yield before, so taking
+# these alternatives always ends.
+def min_yields(rules):
+    yields = dict.fromkeys(rules, float('inf'))
+    shortest = {}
+    changed = True
+    while changed:
+        changed = False
+        for nonterm, alts in rules.items():
+            for alt in alts:
+                n = sum(yields.get(symbol, 1) for symbol in alt)
+                if n < yields[nonterm]:
+                    yields[nonterm] = n
+                    shortest[nonterm] = alt
+                    changed = True
+
+    return yields, shortest
+
+def sentence(rng, rules, yields, shortest, budget):
+    cost = lambda alt: sum(yields.get(symbol, 1) for symbol in alt)
+    stack = ['S']
+    word = []
+    while stack:
+        symbol = stack.pop()
+        if symbol not in rules:
+            word.append(symbol)
+            continue
+
+        # Once the budget is used up, take the shortest way out
+        alts = [alt for alt in rules[symbol] if cost(alt) < float('inf')]
+        if budget > 0:
+            alt = rng.choice(alts)
+            budget -= 1
+        else:
+            alt = shortest[symbol]
+        stack.extend(reversed(alt))
+
+    return ''.join(word)
+
+def random_words(rng, rules, count):
+    terminals = sorted(set(''.join(''.join(alts) for alts in rules.values()))
+                       - set(rules)) or ['a']
+    words = [''.join(rng.choice(terminals)
+                     for _ in range(rng.randint(0, 8)))
+             for _ in range(count)]
+
+    yields, shortest = min_yields(rules)
+    if yields['S'] < float('inf'):
+        sentences = [sentence(rng, rules, yields, shortest,
+                              rng.randint(0, 60))
+                     for _ in range(count)]
+        words += sentences
+
+        # Near misses: delete, insert or replace a char
+        for word in sentences:
+            i = rng.randint(0, len(word))
+            c = rng.choice(terminals)
+            words.append(rng.choice([word[:i] + word[i + 1:],
+                                     word[:i] + c + word[i:],
+                                     word[:i] + c + word[i + 1:]]))
+
+    # Keep the order, it matters for the incremental checks
+    return list(dict.fromkeys(words))
+
+def run_engine(args, engine, grammar, words, timeout):
+    cmd = [args.pda, '-q', '-b', '-S', str(STEPS), '-g', grammar] + \
+          ENGINES[engine]
+    if engine == 'server':
+        data = ''.join('%u %u\n%s' % (i, len(word), word)
+                       for i, word in enumerate(words))
+    else:
+        data = ''.join(word + '\n' for word in words)
+        cmd += ['-f', '-']
+
+    try:
+        p = subprocess.run(cmd, input=data, capture_output=True, text=True,
+                           timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return None, None, False
+
+    if engine == 'server':
+        answers = dict(line.split() for line in p.stdout.splitlines())
+        verdicts = [answers.get(str(i), 'missing')
+                    for i in range(len(words))]
+    else:
+        verdicts = p.stdout.split()
+
+    ns = None
+    for line in p.stderr.splitlines():
+        if line.startswith('bench: '):
+            ns = int(dict(field.split('=')
+                          for field in line[7:].split())['ns'])
+
+    return verdicts, ns, 'falling back' in p.stderr.lower()
+
+# A search of its own for every word.  Its figures are the sum of all words.
+def run_search(args, engine, grammar, words, timeout):
+    cmd = [args.pda, '-q', '-b', '-S', str(STEPS), '-g', grammar] + \
+          ENGINES[engine]
+    deadline = time.monotonic() + timeout
+    verdicts = []
+    ns = 0
+
+    for word in words:
+        try:
+            p = subprocess.run(cmd + [word], capture_output=True, text=True,
+                               timeout=max(0, deadline - time.monotonic()))
+        except subprocess.TimeoutExpired:
+            return None, None, False
+
+        verdicts += p.stdout.split()[:1] or ['missing']
+        for line in p.stderr.splitlines():
+            if line.startswith('bench: '):
+                ns += int(dict(field.split('=')
+                               for field in line[7:].split())['ns'])
+
+    return verdicts, ns, False
+
+class Options(ctypes.Structure):
+    _fields_ = [('engine', ctypes.c_int),
+                ('memoize', ctypes.c_bool),
+                ('normalize', ctypes.c_bool),
+                ('max_depth', ctypes.c_uint),
+                ('max_steps', ctypes.c_ulonglong),
+                ('timeout_ms', ctypes.c_uint),
+                ('deepen', ctypes.c_uint),
+                ('threads', ctypes.c_uint)]
+
+def load_library(name):
+    lib = ctypes.CDLL(name)
+    lib.pda_compile.restype = ctypes.c_void_p
+    lib.pda_compile.argtypes = [ctypes.c_char_p, ctypes.c_size_t,
+                                ctypes.POINTER(Options)]
+    lib.pda_free.argtypes = [ctypes.c_void_p]
+    lib.pda_ctx_new.restype = ctypes.c_void_p
+    lib.pda_ctx_new.argtypes = [ctypes.c_void_p]
+    lib.pda_ctx_free.argtypes = [ctypes.c_void_p]
+    lib.pda_recognize.restype = ctypes.c_int
+    lib.pda_recognize.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                  ctypes.c_size_t]
+    lib.pda_recognize_edit.restype = ctypes.c_int
+    lib.pda_recognize_edit.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                       ctypes.c_size_t, ctypes.c_size_t]
+    return lib
+
+# The budget of the steps applies to every engine, so the library can't hang
+def run_library(lib, engine, text, words):
+    pda_engine, edit = LIBRARY[engine]
+    options = Options(engine=pda_engine, max_steps=STEPS)
+    text = text.encode()
+    grammar = lib.pda_compile(text, len(text), ctypes.byref(options))
+    if not grammar:
+        return None, None
+    ctx = lib.pda_ctx_new(grammar)
+
+    names = ['Nay', 'Yep', 'Limit', 'Undecided']
+    verdicts = []
+    last = ''
+    start = time.perf_counter_ns()
+    for word in words:
+        buf = word.encode()
+        if edit:
+            offset = len(os.path.commonprefix([last, word]))
+            verdict = lib.pda_recognize_edit(ctx, buf, len(buf), offset)
+        else:
+            verdict = lib.pda_recognize(ctx, buf, len(buf))
+        verdicts.append(names[verdict])
+        last = word
+    ns = time.perf_counter_ns() - start
+
+    lib.pda_ctx_free(ctx)
+    lib.pda_free(grammar)
+    return verdicts, ns
+
+def run_compiled(args, grammar, words, timeout, tmp):
+    source = os.path.join(tmp, 'gen.c')
+    binary = os.path.join(tmp, 'gen')
+    subprocess.run([args.pda, '-q', '-g', grammar, '-G', source],
+                   check=True, capture_output=True)
+    subprocess.run([args.cc, '-O1', '-o', binary, source], check=True)
+
+    start = time.perf_counter_ns()
+    try:
+        p = subprocess.run([binary], input=''.join(w + '\n' for w in words),
+                           capture_output=True, text=True, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return None, None
+    return p.stdout.split(), time.perf_counter_ns() - start
+
+class OracleTimeout(Exception):
+    pass
+
+def oracle_timeout(signum, frame):
+    raise OracleTimeout()
+
+def run_oracle(rules, words, max_len, timeout):
+    verdicts = []
+    start = time.perf_counter_ns()
+    signal.signal(signal.SIGALRM, oracle_timeout)
+    signal.setitimer(signal.ITIMER_REAL, timeout)
+    try:
+        for word in words:
+            if len(word) > max_len:
+                verdicts.append('skipped')
+                continue
+            try:
+                yep = oracle.run_pda(word, 'S', rules, trace=False)
+                verdicts.append('Yep' if yep else 'Nay')
+            except RecursionError:
+                verdicts.append('Limit')
+    except OracleTimeout:
+        verdicts += ['timeout'] * (len(words) - len(verdicts))
+    finally:
+        signal.setitimer(signal.ITIMER_REAL, 0)
+
+    return verdicts, time.perf_counter_ns() - start
+
+class Figures:
+    def __init__(self):
+        self.grammars = 0
+        self.words = 0
+        self.undecided = 0
+        self.fallbacks = 0
+        self.timeouts = 0
+        self.ns = 0
+        self.worst = None
+
+    def add(self, seed, words, verdicts, ns, fallback):
+        self.grammars += 1
+        self.fallbacks += fallback
+        if verdicts is None:
+            self.timeouts += 1
+            return
+        self.words += len(words)
+        self.undecided += sum(v not in VERDICTS and v != 'skipped'
+                              for v in verdicts)
+        if ns is not None and words:
+            self.ns += ns
+            per_word = ns / len(words)
+            if not self.worst or per_word > self.worst[0]:
+                self.worst = (per_word, seed)
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare the verdicts and '
+                                                 'the timing of all engines '
+                                                 'on random grammars')
+    parser.add_argument('--pda', default='./PDA', help='PDA binary')
+    parser.add_argument('--lib', default='./libpda.so',
+                        help='PDA library, none if it doesn\'t exist')
+    parser.add_argument('--cc', default=os.environ.get('CC', 'cc'),
+                        help='compiler for the recognizers of -G')
+    parser.add_argument('--seed', type=int, default=0,
+                        help='seed of the first grammar')
+    parser.add_argument('--grammars', type=int, default=200,
+                        help='number of random grammars')
+    parser.add_argument('--words', type=int, default=20,
+                        help='words of every kind per grammar')
+    parser.add_argument('--compiled', type=int, default=10,
+                        help='compile every nth grammar with -G, 0 for none')
+    parser.add_argument('--oracle-len', type=int, default=8,
+                        help='PDA.py decides words up to this length')
+    parser.add_argument('--timeout', type=float, default=10,
+                        help='seconds until a run is given up')
+    args = parser.parse_args()
+
+    lib = load_library(args.lib) if os.path.exists(args.lib) else None
+    names = list(ENGINES) + (list(LIBRARY) if lib else []) + \
+            ['compiled', 'PDA.py']
+    figures = {name: Figures() for name in names}
+    mismatches = 0
+
+    with tempfile.TemporaryDirectory() as tmp:
+        grammar = os.path.join(tmp, 'grammar.txt')
+        for seed in range(args.seed, args.seed + args.grammars):
+            rng = random.Random(seed)
+            rules = random_grammar(rng)
+            words = random_words(rng, rules, args.words)
+            with open(grammar, 'w') as f:
+                f.write(grammar_text(rules))
+
+            results = {}
+            for engine in ENGINES:
+                run = run_search if engine == 'search' else run_engine
+                verdicts, ns, fallback = run(args, engine, grammar, words,
+                                             args.timeout)
+                figures[engine].add(seed, words, verdicts, ns, fallback)
+                results[engine] = verdicts
+
+            for engine in LIBRARY if lib else []:
+                verdicts, ns = run_library(lib, engine, grammar_text(rules),
+                                           words)
+                figures[engine].add(seed, words, verdicts, ns, False)
+                results[engine] = verdicts
+
+            if args.compiled and seed % args.compiled == 0:
+                verdicts, ns = run_compiled(args, grammar, words,
+                                            args.timeout, tmp)
+                figures['compiled'].add(seed, words, verdicts, ns, False)
+                results['compiled'] = verdicts
+
+            verdicts, ns = run_oracle(rules, words, args.oracle_len,
+                                      args.timeout)
+            figures['PDA.py'].add(seed, words, verdicts, ns, False)
+            results['PDA.py'] = verdicts
+
+            # A run that printed too few verdicts is broken, too
+            for i, word in enumerate(words):
+                decided = {name: verdicts[i] if i < len(verdicts)
+                                 else 'missing'
+                           for name, verdicts in results.items()
+                           if verdicts is not None}
+                if len(set(decided.values()) & VERDICTS) > 1 or \
+                   not set(decided.values()) <= \
+                   VERDICTS | {'Limit', 'Undecided', 'timeout', 'skipped'}:
+                    mismatches += 1
+                    print('MISMATCH grammar %u, word %r' % (seed, word))
+                    print(grammar_text(rules), end='')
+                    for name, verdict in decided.items():
+                        print('  %-12s %s' % (name, verdict))
+                    sys.stdout.flush()
+                    break
+
+    print('%-12s %8s %8s %10s %9s %8s %10s %12s %s' %
+          ('engine', 'grammars', 'words', 'undecided', 'fallbacks',
+           'timeouts', 'time/ms', 'ns/word', 'worst'))
+    for name in names:
+        f = figures[name]
+        if not f.grammars:
+            continue
+        worst = '%.0f ns/word, grammar %u' % f.worst if f.worst else ''
+        print('%-12s %8u %8u %10u %9u %8u %10.1f %12.0f %s' %
+              (name, f.grammars, f.words, f.undecided, f.fallbacks,
+               f.timeouts, f.ns / 1e6, f.ns / f.words if f.words else 0,
+               worst))
+
+    if mismatches:
+        sys.exit('%u grammars with mismatches' % mismatches)
+
+if __name__ == '__main__':
+    main()
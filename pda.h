@@ -0,0 +1,105 @@
+/*
+ * The library interface of PDA
+ *
+ * Copyright (c) Ralf Ramsauer, 2017
+ *
+ * Authors:
+ *   Ralf Ramsauer <ralf.ramsauer@oth-regensburg.de>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2. See the
+ * COPYING file in the top-level directory.
+ */
+
+#ifndef PDA_H
+#define PDA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A compiled grammar, together with the tables of its engine.  Once compiled,
+ * it's never modified, so one grammar can serve the contexts of any number of
+ * threads.
+ */
+struct pda_grammar;
+
+/* Everything a recognizer needs while it runs.  A context owns all of its
+ * memory and keeps it from one word to the next, so once it has grown large
+ * enough, recognizing a word doesn't allocate any memory.  A context must
+ * only be used by one thread at a time.
+ */
+struct pda_ctx;
+
+enum pda_engine {
+	PDA_ENGINE_BACKTRACK,
+	PDA_ENGINE_LL1,
+	PDA_ENGINE_EARLEY,
+	PDA_ENGINE_CYK,
+	PDA_ENGINE_SLR,
+};
+
+enum pda_verdict {
+	PDA_NAY,
+	PDA_YEP,
+	/* The engine ran out of a resource, e.g., the maximal depth */
+	PDA_LIMIT,
+	/* The engine used up the budget of the word */
+	PDA_UNDECIDED,
+};
+
+/* If the grammar doesn't permit the LL(1), the CYK or the SLR(1) engine, we
+ * fall back to backtracking.  max_depth is the maximal number of symbols on
+ * the stack of the backtracker, 0 means the default.
+ *
+ * max_steps and timeout_ms limit how many steps and how many milliseconds
+ * the engine may spend on a word, 0 means no limit.  A step of the Earley
+ * engine is an item, and one of CYK a split of a span.  The LL(1) and the
+ * SLR(1) engine take linear time anyway, so the budget doesn't apply to them.
+ * If deepen is not 0, the backtracker searches with a stack of deepen symbols
+ * first, and doubles its depth up to max_depth while that's too shallow.
+ *
+ * If threads is more than 1, the backtracker searches for a derivation of
+ * every word with that many threads of its own.  The context still belongs to
+ * the thread that calls pda_recognize().  Unlike the sequential engines, the
+ * parallel search allocates memory for every word, as it hands snapshots of
+ * the stack from one thread to another.
+ */
+struct pda_options {
+	enum pda_engine engine;
+	bool memoize;
+	bool normalize;
+	unsigned int max_depth;
+	unsigned long long max_steps;
+	unsigned int timeout_ms;
+	unsigned int deepen;
+	unsigned int threads;
+};
+
+/* Compile the grammar in text, in the format of the grammar files, or the
+ * built-in one if text is NULL.  options may be NULL for the defaults.  Errors
+ * are reported on stderr, and NULL is returned.  Like the rest of PDA, the
+ * library exits if it runs out of memory.
+ */
+struct pda_grammar *pda_compile(const char *text, size_t len,
+				const struct pda_options *options);
+
+/* Like pda_compile(), but load the grammar from a text file or a cache */
+struct pda_grammar *pda_load(const char *file,
+			     const struct pda_options *options);
+
+void pda_free(struct pda_grammar *grammar);
+
+struct pda_ctx *pda_ctx_new(const struct pda_grammar *grammar);
+
+enum pda_verdict pda_recognize(struct pda_ctx *ctx, const char *buf,
+			       size_t len);
+
+/* Recognize buf, which is an edit of the last word that ctx recognized: the
+ * first offset chars of both are the same.  The Earley engine only checks
+ * what comes after them again.
+ */
+enum pda_verdict pda_recognize_edit(struct pda_ctx *ctx, const char *buf,
+				    size_t len, size_t offset);
+
+void pda_ctx_free(struct pda_ctx *ctx);
+
+#endif /* PDA_H */
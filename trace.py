@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+
+# Decoder for the binary traces of PDA -B
+#
+# Copyright (c) Ralf Ramsauer, 2017
+#
+# Authors:
+#  Ralf Ramsauer <ralf.ramsauer@oth-regensburg.de>
+#
+# This work is licensed under the terms of the GNU GPL, version 2. See the
+# COPYING file in the top-level directory.
+
+# A trace starts with a line of text, 'PDA trace <version> <byte order>
+# <record size> <productions>', followed by the productions of the engine, one
+# per line.  The rest is records of four 32 bit integers: the step, the
+# position of the read head, the depth of the stack and the event.  An event
+# of 0 or more is the production that the step applied, see enum trace_event
+# in PDA.c for the others.
+#
+# By default, every record is printed as a line of text, like the text trace
+# of PDA, just a lot faster to record.  --summary prints which productions
+# were expanded most instead, grouped by their nonterminal, like a flat
+# flamegraph: the longer the bar, the more often it was expanded.
+
+import argparse
+import struct
+import sys
+
+TRACE_MATCH = -1
+TRACE_FAIL = -2
+TRACE_WORD = -3
+TRACE_VERDICT = -4
+
+VERDICTS = ['Nay', 'Yep', 'Limit', 'Undecided']
+
+BAR_WIDTH = 40
+
+
+def read_header(f):
+    fields = f.readline().decode().split()
+    if fields[:2] != ['PDA', 'trace'] or len(fields) != 6:
+        raise ValueError('not a trace of PDA')
+    version, order, size, count = fields[2:]
+    if version != '1':
+        raise ValueError('unsupported trace version %s' % version)
+
+    record = struct.Struct(('<' if order == 'little' else '>') + 'IIIi')
+    if int(size) != record.size:
+        raise ValueError('unexpected record size %s' % size)
+
+    productions = [f.readline().decode().rstrip('\n')
+                   for _ in range(int(count))]
+    return record, productions
+
+
+def records(f, record):
+    while True:
+        data = f.read(record.size * 4096)
+        if not data:
+            return
+        if len(data) % record.size:
+            raise ValueError('truncated trace')
+        yield from record.iter_unpack(data)
+
+
+def event_name(productions, event, pos):
+    if event >= 0:
+        return productions[event]
+    if event == TRACE_MATCH:
+        return 'match'
+    if event == TRACE_FAIL:
+        return 'fail'
+    if event == TRACE_VERDICT:
+        return VERDICTS[pos] if pos < len(VERDICTS) else 'verdict %d' % pos
+    return 'event %d' % event
+
+
+def print_text(f, record, productions):
+    words = 0
+    for step, pos, depth, event in records(f, record):
+        if event == TRACE_WORD:
+            words += 1
+            print('Word %d: %d chars' % (words, pos))
+        elif event == TRACE_VERDICT:
+            print('%10d  %s' % (step, event_name(productions, event, pos)))
+        else:
+            print('%10d  pos %-8d depth %-8d %s' %
+                  (step, pos, depth, event_name(productions, event, pos)))
+
+
+def bar(count, total):
+    return '#' * (round(BAR_WIDTH * count / total) if total else 0)
+
+
+def print_summary(f, record, productions):
+    expansions = [0] * len(productions)
+    verdicts = [0] * len(VERDICTS)
+    words = steps = matches = fails = 0
+
+    for step, pos, depth, event in records(f, record):
+        if event >= 0:
+            expansions[event] += 1
+        elif event == TRACE_MATCH:
+            matches += 1
+        elif event == TRACE_FAIL:
+            fails += 1
+        elif event == TRACE_WORD:
+            words += 1
+        elif event == TRACE_VERDICT:
+            steps += step
+            if pos < len(VERDICTS):
+                verdicts[pos] += 1
+
+    print('%d words, %d steps, %d matches, %d dead ends' %
+          (words, steps, matches, fails))
+    print(', '.join('%d %s' % (n, v) for n, v in zip(verdicts, VERDICTS)))
+    print()
+
+    # Group the productions by the nonterminal on their left side
+    groups = {}
+    for i, production in enumerate(productions):
+        lhs = production.split(' -> ', 1)[0]
+        groups.setdefault(lhs, []).append(i)
+
+    total = sum(expansions)
+    for lhs, group in sorted(groups.items(),
+                             key=lambda g: -sum(expansions[i] for i in g[1])):
+        count = sum(expansions[i] for i in group)
+        if not count:
+            continue
+        print('%-40s %12d %6.2f%% %s' %
+              (lhs, count, 100 * count / total, bar(count, total)))
+        for i in sorted(group, key=lambda i: -expansions[i]):
+            if expansions[i]:
+                print('  %-38s %12d %6.2f%% %s' %
+                      (productions[i], expansions[i],
+                       100 * expansions[i] / total,
+                       bar(expansions[i], total)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode a binary trace of '
+                                                 'PDA')
+    parser.add_argument('trace', help='the file that PDA -B wrote')
+    parser.add_argument('--summary', action='store_true',
+                        help='print which productions were expanded most')
+    args = parser.parse_args()
+
+    try:
+        with open(args.trace, 'rb') as f:
+            record, productions = read_header(f)
+            if args.summary:
+                print_summary(f, record, productions)
+            else:
+                print_text(f, record, productions)
+    except BrokenPipeError:
+        pass
+    except (OSError, ValueError) as e:
+        print('%s: %s' % (args.trace, e), file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())